@@ -2,165 +2,658 @@
 #include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_font.h>
 #include <allegro5/allegro_ttf.h>
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
 #include <vector>
 #include <sstream>
+#include <string>
+#include <thread>
+#include "EventLog.h"
+#include "WaveFunction.h"
+#include "WorkerPool.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAVE_X86 1
+#endif
 
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
 const float FPS = 60.0f;
 const int GRID_SIZE = 50;
+const float GRID_EXTENT = 750.0f;  // on-screen width of the grid in pixels
+const size_t SIMD_ALIGN = 32;      // wide enough for AVX loads
+const size_t BAND_BYTES = 128 * 1024;  // working set of one row band
+const float PERSPECTIVE = 0.002f;  // render() divides a point by 1 + height * PERSPECTIVE
+
+// Mouse ripples: sin(dist * RIPPLE_WAVENUMBER - phase) * exp(-dist * RIPPLE_DECAY)
+const int MAX_RIPPLES = 64;
+const float RIPPLE_AMPLITUDE = 50.0f;
+const float RIPPLE_WAVENUMBER = 0.05f;
+const float RIPPLE_DECAY = 0.005f;
+const float RIPPLE_VISIBLE = 0.5f;     // on-screen pixels; smaller displacements are skipped
+const float RIPPLE_LIFETIME = 10.0f;   // in phase units, which advance 5 per second
+
+// On-screen pixels a vertex moves per unit of height. render() projects
+// about the screen origin, so heights are magnified most at the grid's far
+// corner, about 3.2x; the cutoff holds there too.
+const float RIPPLE_RENDER_SCALE = hypotf((SCREEN_WIDTH + GRID_EXTENT) / 2 * PERSPECTIVE,
+                                         1.0f + (SCREEN_HEIGHT + GRID_EXTENT) / 2 * PERSPECTIVE);
+const float RIPPLE_RADIUS = logf(RIPPLE_AMPLITUDE * RIPPLE_RENDER_SCALE / RIPPLE_VISIBLE) / RIPPLE_DECAY;
+
+struct Ripple {
+    float x, y;
+    float phase;
+};
+
+// Fixed-capacity ring of active ripples, oldest first. Adding to a full ring
+// replaces the oldest one; since all ripples age at the same rate, expired
+// ripples are always at the front.
+class RippleRing {
+private:
+    Ripple ripples[MAX_RIPPLES];
+    int head;
+    int count;
+    
+public:
+    RippleRing() : head(0), count(0) {}
+    
+    void add(float x, float y) {
+        if (count == MAX_RIPPLES) {
+            head = (head + 1) % MAX_RIPPLES;
+            count--;
+        }
+        Ripple& r = ripples[(head + count) % MAX_RIPPLES];
+        r.x = x;
+        r.y = y;
+        r.phase = 0;
+        count++;
+    }
+    
+    void advance(float phaseDelta) {
+        for (int i = 0; i < count; i++) {
+            ripples[(head + i) % MAX_RIPPLES].phase += phaseDelta;
+        }
+        while (count > 0 && ripples[head].phase > RIPPLE_LIFETIME) {
+            head = (head + 1) % MAX_RIPPLES;
+            count--;
+        }
+    }
+    
+    int size() const { return count; }
+    const Ripple& operator[](int i) const { return ripples[(head + i) % MAX_RIPPLES]; }
+};
+
+// Heap array of floats aligned for SIMD; rows of the grid are padded to a
+// multiple of 8 floats so every row starts on an aligned boundary.
+class AlignedBuffer {
+private:
+    float* ptr;
+    size_t count;
+    
+public:
+    AlignedBuffer() : ptr(nullptr), count(0) {}
+    ~AlignedBuffer() { std::free(ptr); }
+    AlignedBuffer(const AlignedBuffer&) = delete;
+    AlignedBuffer& operator=(const AlignedBuffer&) = delete;
+    
+    void resize(size_t n) {
+        std::free(ptr);
+        size_t bytes = (n * sizeof(float) + SIMD_ALIGN - 1) / SIMD_ALIGN * SIMD_ALIGN;
+        ptr = static_cast<float*>(std::aligned_alloc(SIMD_ALIGN, std::max(bytes, SIMD_ALIGN)));
+        count = n;
+        std::memset(ptr, 0, bytes);
+    }
+    
+    float* data() { return ptr; }
+    const float* data() const { return ptr; }
+    float& operator[](size_t i) { return ptr[i]; }
+    float operator[](size_t i) const { return ptr[i]; }
+    size_t size() const { return count; }
+};
+
+// Row kernels for the height and colour passes. The variants agree to within
+// rounding (the AVX2 one fuses multiply-adds); the widest one the CPU
+// supports is picked at startup.
+namespace kernels {
+
+// h[j] = col1[j] * a + col2[j] * b
+void heightRowScalar(const float* col1, const float* col2, float a, float b, float* h, int n) {
+    for (int j = 0; j < n; j++) {
+        h[j] = col1[j] * a + col2[j] * b;
+    }
+}
+
+// Height to water colour, with foam blended in above 70% of waveHeight
+void shadeRowScalar(const float* h, float* r, float* g, float* b, int n, float waveHeight) {
+    float scale = 1.0f / (2 * waveHeight);
+    float foamStart = waveHeight * 0.7f;
+    float foamScale = 1.0f / (waveHeight * 0.3f);
+    for (int j = 0; j < n; j++) {
+        float normalizedHeight = (h[j] + waveHeight) * scale;
+        float foam = std::max(0.0f, (h[j] - foamStart) * foamScale);
+        r[j] = foam * 0.9f;
+        g[j] = 0.2f + normalizedHeight * 0.3f + foam * 0.9f;
+        b[j] = 0.4f + normalizedHeight * 0.4f + foam * 0.5f;
+    }
+}
+
+#ifdef WAVE_X86
+void heightRowSSE(const float* col1, const float* col2, float a, float b, float* h, int n) {
+    __m128 va = _mm_set1_ps(a);
+    __m128 vb = _mm_set1_ps(b);
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m128 v = _mm_add_ps(_mm_mul_ps(_mm_load_ps(col1 + j), va),
+                              _mm_mul_ps(_mm_load_ps(col2 + j), vb));
+        _mm_store_ps(h + j, v);
+    }
+    heightRowScalar(col1 + j, col2 + j, a, b, h + j, n - j);
+}
+
+void shadeRowSSE(const float* h, float* r, float* g, float* b, int n, float waveHeight) {
+    __m128 height = _mm_set1_ps(waveHeight);
+    __m128 scale = _mm_set1_ps(1.0f / (2 * waveHeight));
+    __m128 foamStart = _mm_set1_ps(waveHeight * 0.7f);
+    __m128 foamScale = _mm_set1_ps(1.0f / (waveHeight * 0.3f));
+    __m128 zero = _mm_setzero_ps();
+    int j = 0;
+    for (; j + 4 <= n; j += 4) {
+        __m128 hv = _mm_load_ps(h + j);
+        __m128 nh = _mm_mul_ps(_mm_add_ps(hv, height), scale);
+        __m128 foam = _mm_max_ps(zero, _mm_mul_ps(_mm_sub_ps(hv, foamStart), foamScale));
+        _mm_store_ps(r + j, _mm_mul_ps(foam, _mm_set1_ps(0.9f)));
+        _mm_store_ps(g + j, _mm_add_ps(_mm_add_ps(_mm_set1_ps(0.2f), _mm_mul_ps(nh, _mm_set1_ps(0.3f))),
+                                       _mm_mul_ps(foam, _mm_set1_ps(0.9f))));
+        _mm_store_ps(b + j, _mm_add_ps(_mm_add_ps(_mm_set1_ps(0.4f), _mm_mul_ps(nh, _mm_set1_ps(0.4f))),
+                                       _mm_mul_ps(foam, _mm_set1_ps(0.5f))));
+    }
+    shadeRowScalar(h + j, r + j, g + j, b + j, n - j, waveHeight);
+}
 
-struct WavePoint {
-    float x, y, z;
-    float height;
-    ALLEGRO_COLOR color;
+__attribute__((target("avx2,fma")))
+void heightRowAVX2(const float* col1, const float* col2, float a, float b, float* h, int n) {
+    __m256 va = _mm256_set1_ps(a);
+    __m256 vb = _mm256_set1_ps(b);
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256 v = _mm256_mul_ps(_mm256_load_ps(col2 + j), vb);
+        _mm256_store_ps(h + j, _mm256_fmadd_ps(_mm256_load_ps(col1 + j), va, v));
+    }
+    heightRowScalar(col1 + j, col2 + j, a, b, h + j, n - j);
+}
+
+__attribute__((target("avx2,fma")))
+void shadeRowAVX2(const float* h, float* r, float* g, float* b, int n, float waveHeight) {
+    __m256 height = _mm256_set1_ps(waveHeight);
+    __m256 scale = _mm256_set1_ps(1.0f / (2 * waveHeight));
+    __m256 foamStart = _mm256_set1_ps(waveHeight * 0.7f);
+    __m256 foamScale = _mm256_set1_ps(1.0f / (waveHeight * 0.3f));
+    __m256 zero = _mm256_setzero_ps();
+    int j = 0;
+    for (; j + 8 <= n; j += 8) {
+        __m256 hv = _mm256_load_ps(h + j);
+        __m256 nh = _mm256_mul_ps(_mm256_add_ps(hv, height), scale);
+        __m256 foam = _mm256_max_ps(zero, _mm256_mul_ps(_mm256_sub_ps(hv, foamStart), foamScale));
+        _mm256_store_ps(r + j, _mm256_mul_ps(foam, _mm256_set1_ps(0.9f)));
+        _mm256_store_ps(g + j, _mm256_fmadd_ps(foam, _mm256_set1_ps(0.9f),
+                               _mm256_fmadd_ps(nh, _mm256_set1_ps(0.3f), _mm256_set1_ps(0.2f))));
+        _mm256_store_ps(b + j, _mm256_fmadd_ps(foam, _mm256_set1_ps(0.5f),
+                               _mm256_fmadd_ps(nh, _mm256_set1_ps(0.4f), _mm256_set1_ps(0.4f))));
+    }
+    shadeRowScalar(h + j, r + j, g + j, b + j, n - j, waveHeight);
+}
+#endif
+
+struct KernelSet {
+    const char* name;
+    void (*heightRow)(const float*, const float*, float, float, float*, int);
+    void (*shadeRow)(const float*, float*, float*, float*, int, float);
 };
 
+const KernelSet SCALAR = { "scalar", heightRowScalar, shadeRowScalar };
+#ifdef WAVE_X86
+const KernelSet SSE = { "sse", heightRowSSE, shadeRowSSE };
+const KernelSet AVX2 = { "avx2", heightRowAVX2, shadeRowAVX2 };
+#endif
+
+// Picks the requested kernel set if the CPU supports it, otherwise the
+// widest supported one ("auto" or an empty name always means the widest).
+const KernelSet& select(const char* requested) {
+    std::string name = requested ? requested : "auto";
+    if (name == "scalar") {
+        return SCALAR;
+    }
+#ifdef WAVE_X86
+    __builtin_cpu_init();
+    bool hasAVX2 = __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    if (name == "sse") {
+        return SSE;
+    }
+    return hasAVX2 ? AVX2 : SSE;
+#else
+    return SCALAR;
+#endif
+}
+
+} // namespace kernels
+
 class WaveSimulation {
 private:
-    std::vector<std::vector<WavePoint>> grid;
+    int gridSize;
+    int stride;  // floats per row, padded to a multiple of 8
+    
+    // Structure-of-arrays grid storage, row-major with 'stride' floats per row
+    AlignedBuffer posX, posY;
+    AlignedBuffer heights;
+    AlignedBuffer red, green, blue;
+    
     float time;
     float waveSpeed;
     float waveHeight;
     float waveFrequency;
-    float mouseWaveX, mouseWaveY;
-    float mouseWaveTime;
-    bool mouseWaveActive;
+    float originX, spacing;
+    RippleRing ripples;
+    bool separable;
+    const kernels::KernelSet* kernel;
+    
+    // Per-column factors of the separable wave terms
+    AlignedBuffer colWave1, colWave2;
+    
+    std::unique_ptr<WorkerPool> pool;
+    int rowsPerBand;
+    
+    // Screen-space mesh, rebuilt in place every frame and drawn in two calls
+    std::vector<ALLEGRO_VERTEX> surfaceVertices;
+    std::vector<ALLEGRO_VERTEX> wireVertices;
+    std::vector<int> surfaceIndices;
+    std::vector<int> wireIndices;
     
 public:
-    WaveSimulation() : time(0), waveSpeed(1.0f), waveHeight(30.0f), 
-                       waveFrequency(0.1f), mouseWaveTime(0), mouseWaveActive(false) {
+    WaveSimulation(int size = GRID_SIZE, const char* kernelName = nullptr, int threads = 0)
+        : gridSize(size), stride((size + 7) & ~7), time(0), waveSpeed(1.0f), waveHeight(30.0f), 
+          waveFrequency(0.1f), originX(0), spacing(0), separable(true),
+          kernel(&kernels::select(kernelName)) {
+        setThreadCount(threads);
         initGrid();
     }
     
+    // 0 means one thread per hardware core
+    void setThreadCount(int threads) {
+        if (threads <= 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        pool.reset(new WorkerPool(threads));
+    }
+    
     void initGrid() {
-        grid.resize(GRID_SIZE);
-        float spacing = 15.0f;
-        float startX = SCREEN_WIDTH / 2 - (GRID_SIZE * spacing) / 2;
-        float startY = SCREEN_HEIGHT / 2 - (GRID_SIZE * spacing) / 2;
+        spacing = GRID_EXTENT / gridSize;
+        float startX = SCREEN_WIDTH / 2 - (gridSize * spacing) / 2;
+        originX = startX;
+        float startY = SCREEN_HEIGHT / 2 - (gridSize * spacing) / 2;
+        
+        size_t cells = (size_t)gridSize * stride;
+        posX.resize(cells);
+        posY.resize(cells);
+        heights.resize(cells);
+        red.resize(cells);
+        green.resize(cells);
+        blue.resize(cells);
+        
+        colWave1.resize(stride);
+        colWave2.resize(stride);
+        
+        // Size bands so the six per-cell arrays of one band stay in L2
+        size_t bandRowBytes = (size_t)stride * sizeof(float) * 6;
+        rowsPerBand = (int)std::max<size_t>(1, BAND_BYTES / bandRowBytes);
         
-        for (int i = 0; i < GRID_SIZE; i++) {
-            grid[i].resize(GRID_SIZE);
-            for (int j = 0; j < GRID_SIZE; j++) {
-                grid[i][j].x = startX + j * spacing;
-                grid[i][j].y = startY + i * spacing;
-                grid[i][j].z = 0;
-                grid[i][j].height = 0;
+        for (int i = 0; i < gridSize; i++) {
+            for (int j = 0; j < gridSize; j++) {
+                posX[i * stride + j] = startX + j * spacing;
+                posY[i * stride + j] = startY + i * spacing;
+            }
+        }
+        
+        initMesh();
+    }
+    
+    // Builds the vertex arrays and the triangle and line index lists once;
+    // only positions and colours change per frame.
+    void initMesh() {
+        ALLEGRO_VERTEX blank = {};
+        blank.color = al_map_rgb_f(0, 0, 0);
+        surfaceVertices.assign((size_t)gridSize * gridSize, blank);
+        blank.color = al_map_rgba_f(1, 1, 1, 0.2f);
+        wireVertices.assign((size_t)gridSize * gridSize, blank);
+        
+        surfaceIndices.clear();
+        wireIndices.clear();
+        surfaceIndices.reserve((size_t)(gridSize - 1) * (gridSize - 1) * 6);
+        wireIndices.reserve((size_t)(gridSize - 1) * (gridSize - 1) * 4);
+        for (int i = 0; i < gridSize - 1; i++) {
+            for (int j = 0; j < gridSize - 1; j++) {
+                int p1 = i * gridSize + j;
+                int p2 = p1 + 1;
+                int p3 = p1 + gridSize;
+                int p4 = p3 + 1;
+                
+                // Triangulated quad
+                surfaceIndices.insert(surfaceIndices.end(), { p1, p2, p3, p2, p3, p4 });
+                
+                // Wireframe: top and left edge of each quad
+                wireIndices.insert(wireIndices.end(), { p1, p2, p1, p3 });
             }
         }
     }
     
     void update(float dt) {
         time += dt * waveSpeed;
-        if (mouseWaveActive) {
-            mouseWaveTime += dt * 5.0f;
-            if (mouseWaveTime > 10.0f) {
-                mouseWaveActive = false;
-                mouseWaveTime = 0;
-            }
+        ripples.advance(dt * 5.0f);
+        
+        if (separable) {
+            updateColumns();
         }
         
-        for (int i = 0; i < GRID_SIZE; i++) {
-            for (int j = 0; j < GRID_SIZE; j++) {
-                WavePoint& p = grid[i][j];
-                
-                // Base wave pattern
-                float wave1 = sin(p.x * waveFrequency + time) * cos(p.y * waveFrequency + time * 0.8f);
-                float wave2 = sin(p.x * waveFrequency * 1.7f + time * 1.3f) * sin(p.y * waveFrequency * 1.3f + time);
-                
-                // Mouse interaction wave
-                float mouseWave = 0;
-                if (mouseWaveActive) {
-                    float dist = sqrt(pow(p.x - mouseWaveX, 2) + pow(p.y - mouseWaveY, 2));
-                    mouseWave = sin(dist * 0.05f - mouseWaveTime) * exp(-dist * 0.005f) * 50.0f;
-                }
-                
-                p.height = (wave1 * 0.5f + wave2 * 0.3f) * waveHeight + mouseWave;
-                
-                // Color based on height
-                float normalizedHeight = (p.height + waveHeight) / (2 * waveHeight);
-                float r = 0.0f;
-                float g = 0.2f + normalizedHeight * 0.3f;
-                float b = 0.4f + normalizedHeight * 0.4f;
-                
-                // Add foam on peaks
-                if (p.height > waveHeight * 0.7f) {
-                    float foam = (p.height - waveHeight * 0.7f) / (waveHeight * 0.3f);
-                    r += foam * 0.9f;
-                    g += foam * 0.9f;
-                    b += foam * 0.5f;
-                }
-                
-                p.color = al_map_rgb_f(r, g, b);
+        // Row bands are claimed by the pool threads; run() returns only when
+        // every band is done, so render() always sees a complete frame.
+        int bands = (gridSize + rowsPerBand - 1) / rowsPerBand;
+        pool->run(bands, [this](int band) {
+            int begin = band * rowsPerBand;
+            updateRows(begin, std::min(gridSize, begin + rowsPerBand));
+        });
+    }
+    
+    // Reference path: evaluates every trig term at every grid point
+    void updateDirect(int row) {
+        float* h = heights.data() + (size_t)row * stride;
+        for (int j = 0; j < gridSize; j++) {
+            float x = posX[row * stride + j];
+            float y = posY[row * stride + j];
+            h[j] = WaveFunction::height(x, y, time, waveFrequency) * waveHeight;
+        }
+    }
+    
+    // Every WaveFunction term is f(x) * g(y), so the trig factors are
+    // evaluated once per column (in updateColumns) and once per row; each
+    // point is then two multiply-adds.
+    static_assert(WaveFunction::TERM_COUNT == 2, "heightRow kernels combine two separable terms");
+    
+    void updateColumns() {
+        const WaveFunction::Term* terms = WaveFunction::TERMS;
+        for (int j = 0; j < gridSize; j++) {
+            float x = posX[j];
+            colWave1[j] = WaveFunction::factorX(terms[0], x, time, waveFrequency);
+            colWave2[j] = WaveFunction::factorX(terms[1], x, time, waveFrequency);
+        }
+    }
+    
+    void updateSeparable(int row) {
+        const WaveFunction::Term* terms = WaveFunction::TERMS;
+        float y = posY[row * stride];
+        float a = WaveFunction::factorY(terms[0], y, time, waveFrequency) * waveHeight;
+        float b = WaveFunction::factorY(terms[1], y, time, waveFrequency) * waveHeight;
+        float* h = heights.data() + (size_t)row * stride;
+        kernel->heightRow(colWave1.data(), colWave2.data(), a, b, h, stride);
+    }
+    
+    void updateRows(int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            if (separable) {
+                updateSeparable(i);
+            } else {
+                updateDirect(i);
+            }
+            addRipples(i);
+            shadeRow(i);
+        }
+    }
+    
+    // Mouse ripples; each one only visits the cells of this row that lie
+    // within RIPPLE_RADIUS of its centre
+    void addRipples(int row) {
+        float* h = heights.data() + (size_t)row * stride;
+        float y = posY[row * stride];
+        for (int k = 0; k < ripples.size(); k++) {
+            const Ripple& r = ripples[k];
+            float dy = y - r.y;
+            if (fabsf(dy) >= RIPPLE_RADIUS) {
+                continue;
+            }
+            float halfWidth = sqrtf(RIPPLE_RADIUS * RIPPLE_RADIUS - dy * dy);
+            int j0 = std::max(0, (int)ceilf((r.x - halfWidth - originX) / spacing));
+            int j1 = std::min(gridSize - 1, (int)floorf((r.x + halfWidth - originX) / spacing));
+            for (int j = j0; j <= j1; j++) {
+                float dx = originX + j * spacing - r.x;
+                float dist = sqrtf(dx * dx + dy * dy);
+                h[j] += sinf(dist * RIPPLE_WAVENUMBER - r.phase) * expf(-dist * RIPPLE_DECAY) * RIPPLE_AMPLITUDE;
             }
         }
     }
     
+    void shadeRow(int row) {
+        size_t offset = (size_t)row * stride;
+        kernel->shadeRow(heights.data() + offset, red.data() + offset, green.data() + offset,
+                         blue.data() + offset, stride, waveHeight);
+    }
+    
     void render() {
-        // Draw wave grid
-        for (int i = 0; i < GRID_SIZE - 1; i++) {
-            for (int j = 0; j < GRID_SIZE - 1; j++) {
-                WavePoint& p1 = grid[i][j];
-                WavePoint& p2 = grid[i][j + 1];
-                WavePoint& p3 = grid[i + 1][j];
-                WavePoint& p4 = grid[i + 1][j + 1];
-                
-                // Calculate screen positions with perspective
-                float perspective = 0.002f;
-                auto project = [perspective](WavePoint& p) -> std::pair<float, float> {
-                    float scale = 1.0f / (1.0f + p.height * perspective);
-                    return {p.x * scale, (p.y - p.height) * scale};
-                };
-                
-                auto [x1, y1] = project(p1);
-                auto [x2, y2] = project(p2);
-                auto [x3, y3] = project(p3);
-                auto [x4, y4] = project(p4);
-                
-                // Draw triangulated quad
-                float vertices[] = {
-                    x1, y1, x2, y2, x3, y3,
-                    x2, y2, x3, y3, x4, y4
-                };
+        // Project every grid point once into the persistent vertex arrays
+        for (int i = 0; i < gridSize; i++) {
+            for (int j = 0; j < gridSize; j++) {
+                size_t k = (size_t)i * stride + j;
+                size_t v = (size_t)i * gridSize + j;
+                float scale = 1.0f / (1.0f + heights[k] * PERSPECTIVE);
+                float sx = posX[k] * scale;
+                float sy = (posY[k] - heights[k]) * scale;
                 
-                // Average color for the quad
-                float r = (al_unmap_rgb_f(p1.color).r + al_unmap_rgb_f(p2.color).r + 
-                          al_unmap_rgb_f(p3.color).r + al_unmap_rgb_f(p4.color).r) / 4;
-                float g = (al_unmap_rgb_f(p1.color).g + al_unmap_rgb_f(p2.color).g + 
-                          al_unmap_rgb_f(p3.color).g + al_unmap_rgb_f(p4.color).g) / 4;
-                float b = (al_unmap_rgb_f(p1.color).b + al_unmap_rgb_f(p2.color).b + 
-                          al_unmap_rgb_f(p3.color).b + al_unmap_rgb_f(p4.color).b) / 4;
-                
-                ALLEGRO_COLOR color = al_map_rgb_f(r, g, b);
-                
-                al_draw_filled_triangle(x1, y1, x2, y2, x3, y3, color);
-                al_draw_filled_triangle(x2, y2, x3, y3, x4, y4, color);
-                
-                // Draw wireframe
-                al_draw_line(x1, y1, x2, y2, al_map_rgba_f(1, 1, 1, 0.2f), 1);
-                al_draw_line(x1, y1, x3, y3, al_map_rgba_f(1, 1, 1, 0.2f), 1);
+                surfaceVertices[v].x = sx;
+                surfaceVertices[v].y = sy;
+                surfaceVertices[v].color = al_map_rgb_f(red[k], green[k], blue[k]);
+                wireVertices[v].x = sx;
+                wireVertices[v].y = sy;
             }
         }
+        
+        // One call for the surface and one for the wireframe
+        al_draw_indexed_prim(surfaceVertices.data(), nullptr, nullptr, surfaceIndices.data(),
+                             (int)surfaceIndices.size(), ALLEGRO_PRIM_TRIANGLE_LIST);
+        al_draw_indexed_prim(wireVertices.data(), nullptr, nullptr, wireIndices.data(),
+                             (int)wireIndices.size(), ALLEGRO_PRIM_LINE_LIST);
     }
     
     void createMouseWave(float x, float y) {
-        mouseWaveX = x;
-        mouseWaveY = y;
-        mouseWaveTime = 0;
-        mouseWaveActive = true;
+        ripples.add(x, y);
     }
     
     void adjustSpeed(float delta) { waveSpeed = std::max(0.1f, std::min(5.0f, waveSpeed + delta)); }
     void adjustHeight(float delta) { waveHeight = std::max(5.0f, std::min(100.0f, waveHeight + delta)); }
     void adjustFrequency(float delta) { waveFrequency = std::max(0.02f, std::min(0.5f, waveFrequency + delta)); }
     
+    void toggleSeparable() { separable = !separable; }
+    
     float getSpeed() const { return waveSpeed; }
     float getHeight() const { return waveHeight; }
     float getFrequency() const { return waveFrequency; }
+    bool isSeparable() const { return separable; }
+    const char* getKernelName() const { return kernel->name; }
+    int getThreadCount() const { return pool->size(); }
+    int getRippleCount() const { return ripples.size(); }
 };
 
-int main() {
+// Strong scaling: the same grid is updated with 1, 2, 4, ... threads up to
+// maxThreads, and each run is reported relative to the single-thread time.
+int runScalingBenchmark(int gridSize, const char* kernelName, int maxThreads, int frames) {
+    if (maxThreads <= 0) {
+        maxThreads = std::max(1u, std::thread::hardware_concurrency());
+    }
+    
+    std::vector<int> threadCounts;
+    for (int t = 1; t < maxThreads; t *= 2) {
+        threadCounts.push_back(t);
+    }
+    threadCounts.push_back(maxThreads);
+    
+    WaveSimulation wave(gridSize, kernelName, 1);
+    printf("Grid %dx%d, kernel %s, %d frames per run\n", gridSize, gridSize, wave.getKernelName(), frames);
+    printf("%8s %12s %10s %11s\n", "threads", "ms/frame", "speedup", "efficiency");
+    
+    double baseline = 0;
+    for (int threads : threadCounts) {
+        wave.setThreadCount(threads);
+        wave.update(1.0f / FPS);  // warm up caches and wake the workers
+        
+        auto start = std::chrono::steady_clock::now();
+        for (int f = 0; f < frames; f++) {
+            wave.update(1.0f / FPS);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        
+        double msPerFrame = elapsed.count() / frames;
+        if (threads == 1) {
+            baseline = msPerFrame;
+        }
+        double speedup = baseline / msPerFrame;
+        printf("%8d %12.3f %9.2fx %10.0f%%\n", threads, msPerFrame, speedup, 100.0 * speedup / threads);
+    }
+    return 0;
+}
+
+// Keyboard and mouse handling, shared by the interactive run and the
+// replays; false when the key asks to exit
+bool handleInput(const ALLEGRO_EVENT& event, WaveSimulation& wave) {
+    switch (event.type) {
+        case ALLEGRO_EVENT_KEY_DOWN:
+            switch (event.keyboard.keycode) {
+                case ALLEGRO_KEY_ESCAPE:
+                    return false;
+                case ALLEGRO_KEY_Q:
+                    wave.adjustSpeed(0.1f);
+                    break;
+                case ALLEGRO_KEY_A:
+                    wave.adjustSpeed(-0.1f);
+                    break;
+                case ALLEGRO_KEY_W:
+                    wave.adjustHeight(5.0f);
+                    break;
+                case ALLEGRO_KEY_S:
+                    wave.adjustHeight(-5.0f);
+                    break;
+                case ALLEGRO_KEY_E:
+                    wave.adjustFrequency(0.01f);
+                    break;
+                case ALLEGRO_KEY_D:
+                    wave.adjustFrequency(-0.01f);
+                    break;
+                case ALLEGRO_KEY_M:
+                    wave.toggleSeparable();
+                    break;
+            }
+            break;
+            
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+            if (event.mouse.button == 1) {
+                wave.createMouseWave(event.mouse.x, event.mouse.y);
+            }
+            break;
+    }
+    return true;
+}
+
+// Feeds the records stamped with step, from index next on, to the
+// simulation as if they had just arrived; returns the index of the first
+// later record. This program writes no PARAMETER records.
+size_t replayStep(const EventLog::Log& log, size_t next, unsigned step, WaveSimulation& wave) {
+    for (; next < log.records.size() && log.records[next].step <= step; next++) {
+        if (log.records[next].type != EventLog::PARAMETER) {
+            handleInput(EventLog::toEvent(log.records[next], log.header, SCREEN_WIDTH, SCREEN_HEIGHT), wave);
+        }
+    }
+    return next;
+}
+
+void printFrameTimes(const char* label, std::vector<double> times) {
+    if (times.empty()) {
+        printf("%s: no frames\n", label);
+        return;
+    }
+    std::sort(times.begin(), times.end());
+    double sum = 0;
+    for (double t : times) {
+        sum += t;
+    }
+    printf("%s: %zu frames, min %.3f ms, avg %.3f ms, p99 %.3f ms\n",
+           label, times.size(), times.front(), sum / times.size(), EventLog::percentile(times, 99.0));
+}
+
+// Replays a log without opening a window, one update() per recorded step
+// and as fast as they run; rendering needs a display, so only the
+// simulation is timed.
+int runReplay(const EventLog::Log& log, int gridSize, const char* kernelName, int threads) {
+    WaveSimulation wave(gridSize, kernelName, threads);
+    printf("Replay: grid %dx%d, kernel %s, %d threads, %u steps\n",
+           gridSize, gridSize, wave.getKernelName(), wave.getThreadCount(), log.steps);
+    
+    std::vector<double> times;
+    times.reserve(log.steps);
+    size_t next = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (unsigned step = 0; step < log.steps; step++) {
+        next = replayStep(log, next, step, wave);
+        auto frameStart = std::chrono::steady_clock::now();
+        wave.update(log.header.timestep);
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - frameStart;
+        times.push_back(elapsed.count());
+    }
+    std::chrono::duration<double> total = std::chrono::steady_clock::now() - start;
+    
+    printFrameTimes("update", times);
+    printf("%.3f s, %.1f steps/s\n", total.count(), log.steps / total.count());
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int gridSize = GRID_SIZE;
+    const char* kernelName = nullptr;
+    int threads = 0;
+    int benchFrames = 0;
+    const char* recordPath = nullptr;
+    const char* replayPath = nullptr;
+    bool headless = false;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--grid") == 0 && i + 1 < argc) {
+            gridSize = std::max(2, atoi(argv[++i]));
+        } else if (strcmp(argv[i], "--kernel") == 0 && i + 1 < argc) {
+            kernelName = argv[++i];
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench") == 0) {
+            benchFrames = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 100;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        }
+    }
+    
+    if (benchFrames > 0) {
+        return runScalingBenchmark(gridSize, kernelName, threads, benchFrames);
+    }
+    EventLog::Log replay;
+    if (replayPath && !replay.load(replayPath)) {
+        fprintf(stderr, "Cannot read event log %s\n", replayPath);
+        return -1;
+    }
+    if (replayPath && headless) {
+        return runReplay(replay, gridSize, kernelName, threads);
+    }
+    
     if (!al_init()) {
         return -1;
     }
@@ -178,17 +671,30 @@ int main() {
     
     ALLEGRO_FONT* font = al_create_builtin_font();
     ALLEGRO_EVENT_QUEUE* queue = al_create_event_queue();
-    ALLEGRO_TIMER* timer = al_create_timer(1.0 / FPS);
+    ALLEGRO_TIMER* timer = al_create_timer(replayPath ? replay.header.timestep : 1.0 / FPS);
     
     al_register_event_source(queue, al_get_display_event_source(display));
     al_register_event_source(queue, al_get_timer_event_source(timer));
     al_register_event_source(queue, al_get_keyboard_event_source());
     al_register_event_source(queue, al_get_mouse_event_source());
     
-    WaveSimulation wave;
+    WaveSimulation wave(gridSize, kernelName, threads);
     bool running = true;
     bool redraw = true;
     
+    // Input is recorded against the number of updates before it; a replay
+    // feeds it back before the same update and ignores live input but ESC
+    EventLog::Writer recorder;
+    EventLog::Record record;
+    if (recordPath && !recorder.open(recordPath, 1.0f / FPS, al_get_display_width(display),
+                                         al_get_display_height(display))) {
+        fprintf(stderr, "Cannot write event log %s\n", recordPath);
+    }
+    unsigned steps = 0;
+    size_t nextRecord = 0;
+    std::vector<double> frameTimes;
+    std::chrono::steady_clock::time_point lastFlip;
+    
     al_start_timer(timer);
     
     while (running) {
@@ -197,7 +703,15 @@ int main() {
         
         switch (event.type) {
             case ALLEGRO_EVENT_TIMER:
-                wave.update(1.0f / FPS);
+                if (replayPath) {
+                    if (steps == replay.steps) {
+                        running = false;
+                        break;
+                    }
+                    nextRecord = replayStep(replay, nextRecord, steps, wave);
+                }
+                wave.update(replayPath ? replay.header.timestep : 1.0f / FPS);
+                steps++;
                 redraw = true;
                 break;
                 
@@ -206,35 +720,17 @@ int main() {
                 break;
                 
             case ALLEGRO_EVENT_KEY_DOWN:
-                switch (event.keyboard.keycode) {
-                    case ALLEGRO_KEY_ESCAPE:
-                        running = false;
-                        break;
-                    case ALLEGRO_KEY_Q:
-                        wave.adjustSpeed(0.1f);
-                        break;
-                    case ALLEGRO_KEY_A:
-                        wave.adjustSpeed(-0.1f);
-                        break;
-                    case ALLEGRO_KEY_W:
-                        wave.adjustHeight(5.0f);
-                        break;
-                    case ALLEGRO_KEY_S:
-                        wave.adjustHeight(-5.0f);
-                        break;
-                    case ALLEGRO_KEY_E:
-                        wave.adjustFrequency(0.01f);
-                        break;
-                    case ALLEGRO_KEY_D:
-                        wave.adjustFrequency(-0.01f);
-                        break;
-                }
-                break;
-                
+            case ALLEGRO_EVENT_MOUSE_AXES:
             case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
-                if (event.mouse.button == 1) {
-                    wave.createMouseWave(event.mouse.x, event.mouse.y);
+            case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+                if (replayPath) {
+                    running = !(event.type == ALLEGRO_EVENT_KEY_DOWN && event.keyboard.keycode == ALLEGRO_KEY_ESCAPE);
+                    break;
                 }
+                if (recorder.isOpen() && EventLog::toRecord(event, steps, record)) {
+                    recorder.write(record);
+                }
+                running = handleInput(event, wave);
                 break;
         }
         
@@ -252,15 +748,35 @@ int main() {
             al_draw_text(font, al_map_rgb(255, 255, 255), 10, 70, 0, "W/S - Height");
             al_draw_text(font, al_map_rgb(255, 255, 255), 10, 90, 0, "E/D - Frequency");
             al_draw_text(font, al_map_rgb(255, 255, 255), 10, 110, 0, "Click - Create Wave");
+            al_draw_text(font, al_map_rgb(255, 255, 255), 10, 130, 0, "M - Separable/Direct Update");
             
             std::stringstream ss;
             ss << "Speed: " << wave.getSpeed() << " Height: " << wave.getHeight() << " Freq: " << wave.getFrequency();
-            al_draw_text(font, al_map_rgb(255, 255, 0), 10, 140, 0, ss.str().c_str());
+            al_draw_text(font, al_map_rgb(255, 255, 0), 10, 160, 0, ss.str().c_str());
+            ss.str("");
+            ss << "Grid: " << gridSize << "x" << gridSize << " Update: " << (wave.isSeparable() ? "separable" : "direct")
+               << " Kernel: " << wave.getKernelName() << " Threads: " << wave.getThreadCount()
+               << " Ripples: " << wave.getRippleCount();
+            al_draw_text(font, al_map_rgb(255, 255, 0), 10, 180, 0, ss.str().c_str());
             
             al_flip_display();
+            
+            auto flip = std::chrono::steady_clock::now();
+            if (lastFlip != std::chrono::steady_clock::time_point()) {
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(flip - lastFlip).count());
+            }
+            lastFlip = flip;
         }
     }
     
+    if (recorder.isOpen() && !recorder.close(steps)) {
+        fprintf(stderr, "Cannot write event log %s\n", recordPath);
+    }
+    if (replayPath) {
+        printf("Replayed %u of %u steps\n", steps, replay.steps);
+        printFrameTimes("frame", frameTimes);
+    }
+    
     al_destroy_font(font);
     al_destroy_timer(timer);
     al_destroy_event_queue(queue);
@@ -0,0 +1,51 @@
+#ifndef COMMAND_RING_H
+#define COMMAND_RING_H
+
+#include <atomic>
+
+// Bounded lock-free queue from one producer thread to one consumer thread.
+// Each index is written by one side only, so push() and pop() need no
+// locks or compare-and-swap; the release store of an index publishes the
+// slot it covers. The indices run freely and wrap modulo 2^32, which
+// CAPACITY (a power of two) divides.
+template <typename T, unsigned CAPACITY>
+class CommandRing {
+    static_assert(CAPACITY > 0 && (CAPACITY & (CAPACITY - 1)) == 0, "CAPACITY must be a power of two");
+
+private:
+    T slots[CAPACITY];
+    alignas(64) std::atomic<unsigned> head;   // next slot to read, advanced by the consumer
+    alignas(64) std::atomic<unsigned> tail;   // next slot to write, advanced by the producer
+
+public:
+    CommandRing() : head(0), tail(0) {
+    }
+
+    // Producer side; false when the ring is full
+    bool push(const T& value) {
+        unsigned t = tail.load(std::memory_order_relaxed);
+        if (t - head.load(std::memory_order_acquire) == CAPACITY) {
+            return false;
+        }
+        slots[t & (CAPACITY - 1)] = value;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // Consumer side; false when the ring is empty
+    bool pop(T& value) {
+        unsigned h = head.load(std::memory_order_relaxed);
+        if (h == tail.load(std::memory_order_acquire)) {
+            return false;
+        }
+        value = slots[h & (CAPACITY - 1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+
+private:
+    CommandRing(const CommandRing&);
+    CommandRing& operator=(const CommandRing&);
+};
+
+#endif
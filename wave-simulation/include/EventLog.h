@@ -0,0 +1,182 @@
+#ifndef EVENT_LOG_H
+#define EVENT_LOG_H
+
+#include <allegro5/allegro.h>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Recorded input for deterministic replays, shared by wave_simulation and
+// wave_simple. A log is a header (including the simulation time step) and
+// one 16-byte record per key press, mouse move, mouse button event or
+// parameter setting, stamped with the number of simulation steps completed
+// when it arrived. A program can open its logs with step 0 PARAMETER
+// records, under ids of its own, for settings a replay should start from.
+// A replay steps the simulation itself and feeds each event through the
+// program's usual event switch just before the step that follows its stamp,
+// so every replay of a log runs exactly the same workload, whatever the
+// speed or window of the recording.
+namespace EventLog {
+
+static const char MAGIC[4] = { 'W', 'S', 'E', 'V' };
+static const uint32_t VERSION = 1;
+
+enum Type { KEY_DOWN = 1, MOUSE_MOVE, MOUSE_DOWN, MOUSE_UP, PARAMETER, END };
+
+struct Header {
+    char magic[4];
+    uint32_t version;
+    float timestep;            // seconds per simulation step
+    uint16_t width, height;    // window the mouse positions refer to
+};
+
+struct Record {
+    uint32_t step;     // simulation steps completed before the event
+    uint8_t type;
+    uint8_t button;    // mouse button
+    uint16_t key;      // Allegro keycode, or the PARAMETER's id
+    int16_t x, y;      // mouse position in window pixels
+    float value;       // PARAMETER
+};
+
+inline Record parameter(uint32_t step, uint16_t id, float value) {
+    Record record;
+    std::memset(&record, 0, sizeof(record));
+    record.step = step;
+    record.type = PARAMETER;
+    record.key = id;
+    record.value = value;
+    return record;
+}
+
+// The input events a log keeps; everything else (timers, display events)
+// is driven by the replay itself
+inline bool toRecord(const ALLEGRO_EVENT& event, uint32_t step, Record& record) {
+    std::memset(&record, 0, sizeof(record));
+    record.step = step;
+    switch (event.type) {
+        case ALLEGRO_EVENT_KEY_DOWN:
+            record.type = KEY_DOWN;
+            record.key = (uint16_t)event.keyboard.keycode;
+            return true;
+        case ALLEGRO_EVENT_MOUSE_AXES:
+            record.type = MOUSE_MOVE;
+            break;
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+            record.type = MOUSE_DOWN;
+            break;
+        case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+            record.type = MOUSE_UP;
+            break;
+        default:
+            return false;
+    }
+    record.button = (uint8_t)event.mouse.button;
+    record.x = (int16_t)event.mouse.x;
+    record.y = (int16_t)event.mouse.y;
+    return true;
+}
+
+// Rebuilds the input event of a KEY_DOWN or MOUSE_* record, with mouse
+// positions scaled from the recorded window to one of the given size
+inline ALLEGRO_EVENT toEvent(const Record& record, const Header& header, int width, int height) {
+    ALLEGRO_EVENT event;
+    std::memset(&event, 0, sizeof(event));
+    if (record.type == KEY_DOWN) {
+        event.type = ALLEGRO_EVENT_KEY_DOWN;
+        event.keyboard.keycode = record.key;
+        return event;
+    }
+    event.type = record.type == MOUSE_MOVE ? ALLEGRO_EVENT_MOUSE_AXES
+               : record.type == MOUSE_DOWN ? ALLEGRO_EVENT_MOUSE_BUTTON_DOWN
+               : ALLEGRO_EVENT_MOUSE_BUTTON_UP;
+    event.mouse.button = record.button;
+    event.mouse.x = header.width ? record.x * width / header.width : record.x;
+    event.mouse.y = header.height ? record.y * height / header.height : record.y;
+    return event;
+}
+
+// Nearest-rank percentile (0 to 100) of samples sorted in ascending order,
+// as both programs report replayed frame times
+inline double percentile(const std::vector<double>& sorted, double p) {
+    size_t rank = (size_t)std::ceil(p * sorted.size() / 100.0);
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+class Writer {
+private:
+    std::ofstream file;
+
+public:
+    bool open(const std::string& path, float timestep, int width, int height) {
+        file.open(path.c_str(), std::ios::binary);
+        if (!file.is_open()) {
+            return false;
+        }
+        Header header;
+        std::memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = VERSION;
+        header.timestep = timestep;
+        header.width = (uint16_t)width;
+        header.height = (uint16_t)height;
+        file.write((const char*)&header, sizeof(header));
+        return (bool)file;
+    }
+
+    bool isOpen() const { return file.is_open(); }
+
+    void write(const Record& record) {
+        if (file.is_open()) {
+            file.write((const char*)&record, sizeof(record));
+        }
+    }
+
+    // Marks the length of the run, so a replay ends where the recording did
+    bool close(uint32_t steps) {
+        if (!file.is_open()) {
+            return true;
+        }
+        Record end;
+        std::memset(&end, 0, sizeof(end));
+        end.step = steps;
+        end.type = END;
+        write(end);
+        file.close();
+        return !file.fail();
+    }
+};
+
+struct Log {
+    Header header;
+    std::vector<Record> records;   // in step order, without the END record
+    uint32_t steps;                // length of the recorded run
+
+    bool load(const std::string& path) {
+        std::ifstream file(path.c_str(), std::ios::binary);
+        if (!file.read((char*)&header, sizeof(header)) ||
+            std::memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.version != VERSION ||
+            !(header.timestep > 0.0f)) {
+            return false;
+        }
+        records.clear();
+        steps = 0;
+        Record record;
+        while (file.read((char*)&record, sizeof(record))) {
+            if (record.type == END) {
+                steps = record.step;
+                return true;
+            }
+            records.push_back(record);
+        }
+        // A recording that was cut short still replays up to its last event
+        steps = records.empty() ? 0 : records.back().step + 1;
+        return true;
+    }
+};
+
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef FFT_H
+#define FFT_H
+
+#include <vector>
+#include "WorkerPool.h"
+
+// In-place complex FFT for power-of-two sizes on split real/imaginary
+// arrays. Stages are fused in pairs into radix-4 passes, with one radix-2
+// pass first when log2(size) is odd; passes with four or more independent
+// butterflies run four at a time with SSE. Neither direction normalises.
+class FFT {
+private:
+    struct Stage {
+        int half;            // butterfly span of the first radix-2 step
+        bool radix4;
+        size_t twiddles;     // offset into twiddleRe/twiddleIm
+    };
+
+    int n;
+    std::vector<int> reversed;
+    std::vector<Stage> stages;
+    std::vector<float> twiddleRe, twiddleIm;
+
+    void permute(float* re, float* im) const;
+
+public:
+    explicit FFT(int size);
+
+    void forward(float* re, float* im) const;
+    void inverse(float* re, float* im) const;
+
+    // Transforms 'width' adjacent columns of a row-major matrix at once. Each
+    // butterfly works on whole row segments, so memory is walked row by row
+    // and the columns fill the SIMD lanes.
+    void forwardColumns(float* re, float* im, size_t stride, int width) const;
+    void inverseColumns(float* re, float* im, size_t stride, int width) const;
+
+    int getSize() const { return n; }
+
+    static bool isPowerOfTwo(int size) { return size > 0 && (size & (size - 1)) == 0; }
+};
+
+// Square 2D FFT: rows are transformed in parallel, then strips of columns
+// are transformed in parallel without transposing the matrix. Rows are
+// getStride() floats apart; the padding keeps a column strip from mapping
+// every row onto the same cache sets at power-of-two sizes.
+class FFT2D {
+private:
+    static const int STRIP = 16;   // columns per task in the column pass
+    static const int PAD = 16;     // floats of padding after each row
+
+    FFT fft;
+    WorkerPool* pool;
+    int n;
+    int stride;
+
+    void transformRows(float* re, float* im, bool inverse);
+    void transformColumns(float* re, float* im, bool inverse);
+
+public:
+    FFT2D(int size, WorkerPool* pool);
+
+    void forward(float* re, float* im);
+    void inverse(float* re, float* im);
+    int getSize() const { return n; }
+    int getStride() const { return stride; }
+};
+
+#endif
@@ -0,0 +1,80 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// Per-frame timings of named sections, kept for the last HISTORY frames.
+//
+// CPU sections are timed with steady_clock, or given a time measured
+// elsewhere (the simulation steps on its own thread, zero or more times per
+// frame); a section timed several times in one frame accumulates. GPU
+// sections wrap GL_TIME_ELAPSED queries. Each GPU
+// section owns LATENCY queries used round-robin, and a result is only
+// collected LATENCY frames after it was issued, when the driver has long
+// finished it, so reading timings never stalls the pipeline. GPU sections
+// cannot nest (one GL_TIME_ELAPSED query may be active at a time) and are
+// timed at most once per frame.
+class FrameProfiler {
+public:
+    static const int HISTORY = 240;
+    static const int LATENCY = 3;
+
+    // Marks a section with no sample (a GPU result not in yet)
+    static const float MISSING;
+
+private:
+    struct Section {
+        std::string name;
+        bool gpu;
+        std::chrono::steady_clock::time_point start;
+        GLuint queries[LATENCY];
+        bool issued[LATENCY];
+        float history[HISTORY];   // ms, indexed by frame % HISTORY
+    };
+
+    std::vector<Section> sections;
+    long long frame;   // the frame being recorded
+
+    void collectGpuResults();
+
+public:
+    FrameProfiler();
+    ~FrameProfiler();
+
+    // Sections are listed (in the graph and the CSV) in the order they are
+    // added. Adding a GPU section needs a current GL context.
+    int addSection(const std::string& name, bool gpu);
+
+    void beginCpu(int section);
+    void endCpu(int section);
+    void addCpuTime(int section, float milliseconds);
+    void beginGpu(int section);
+    void endGpu(int section);
+
+    // Closes the current frame and starts recording the next one
+    void endFrame();
+
+    int getSectionCount() const { return (int)sections.size(); }
+    const std::string& getSectionName(int section) const { return sections[section].name; }
+    bool isGpuSection(int section) const { return sections[section].gpu; }
+
+    // Number of completed frames held in the history (at most HISTORY)
+    int getFrameCount() const;
+    // Time of a section age frames before the current one (1 = the last
+    // completed frame), or MISSING
+    float getTime(int section, int age) const;
+
+    // Writes the history, oldest frame first, one column per section
+    bool writeCsv(const std::string& path) const;
+
+private:
+    FrameProfiler(const FrameProfiler&);
+    FrameProfiler& operator=(const FrameProfiler&);
+};
+
+#endif
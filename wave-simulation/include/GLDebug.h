@@ -0,0 +1,71 @@
+#ifndef GL_DEBUG_H
+#define GL_DEBUG_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+// OpenGL diagnostics, chosen at compile time with GL_DEBUG_LEVEL:
+//
+//   GL_DEBUG_OFF      nothing is checked; the macros below compile away
+//   GL_DEBUG_ERRORS   API errors are reported through the KHR_debug callback
+//   GL_DEBUG_VERBOSE  every driver message but notifications, delivered
+//                     synchronously so a breakpoint in the callback stops at
+//                     the offending call, and scopes show up as debug groups
+//                     in tools such as RenderDoc or apitrace
+//
+// Without -DGL_DEBUG_LEVEL=... release builds (NDEBUG) get GL_DEBUG_OFF and
+// others GL_DEBUG_VERBOSE.
+//
+// Messages name the innermost GL_DEBUG_SCOPE active when the driver raised
+// them. When the driver lacks KHR_debug, GL_CHECK falls back to glGetError at
+// the named call site; with the callback installed it costs nothing.
+#define GL_DEBUG_OFF 0
+#define GL_DEBUG_ERRORS 1
+#define GL_DEBUG_VERBOSE 2
+
+#ifndef GL_DEBUG_LEVEL
+#ifdef NDEBUG
+#define GL_DEBUG_LEVEL GL_DEBUG_OFF
+#else
+#define GL_DEBUG_LEVEL GL_DEBUG_VERBOSE
+#endif
+#endif
+
+namespace GLDebug {
+
+// Installs the debug callback if the context supports KHR_debug (or is
+// OpenGL 4.3+). Call once with the context current.
+void initialize();
+
+// Reports any pending glGetError at site, unless the callback is installed
+void check(const char* site);
+
+// Names the GL calls made during its lifetime
+class Scope {
+private:
+    const char* previous;
+
+public:
+    explicit Scope(const char* site);
+    ~Scope();
+
+private:
+    Scope(const Scope&);
+    Scope& operator=(const Scope&);
+};
+
+}
+
+#define GL_DEBUG_CONCAT_(a, b) a##b
+#define GL_DEBUG_CONCAT(a, b) GL_DEBUG_CONCAT_(a, b)
+
+#if GL_DEBUG_LEVEL > GL_DEBUG_OFF
+#define GL_DEBUG_SCOPE(site) GLDebug::Scope GL_DEBUG_CONCAT(glDebugScope, __LINE__)(site)
+#define GL_CHECK(site) GLDebug::check(site)
+#else
+#define GL_DEBUG_SCOPE(site) ((void)0)
+#define GL_CHECK(site) ((void)0)
+#endif
+
+#endif
@@ -0,0 +1,49 @@
+#ifndef HEADLESS_CONTEXT_H
+#define HEADLESS_CONTEXT_H
+
+#include <EGL/egl.h>
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <string>
+#include <vector>
+
+// An OpenGL 3.3 core context without a window, for benchmarks on machines
+// with no display (e.g. CI boxes running Mesa's llvmpipe). The context comes
+// from EGL: a surfaceless Mesa display when the driver offers one, otherwise
+// the default display with a 1x1 pbuffer. Frames are rendered into an
+// RGBA8 + depth framebuffer object of the requested size, which stays bound
+// so WaveRenderer::render() draws into it unchanged.
+class HeadlessContext {
+private:
+    EGLDisplay display;
+    EGLSurface surface;
+    EGLContext context;
+
+    GLuint framebuffer;
+    GLuint colorBuffer;
+    GLuint depthBuffer;
+    int width, height;
+
+    bool createContext();
+    bool createFramebuffer();
+
+public:
+    HeadlessContext(int width, int height);
+    ~HeadlessContext();
+
+    bool initialize();
+
+    int getWidth() const { return width; }
+    int getHeight() const { return height; }
+
+    // Reads the framebuffer back (waiting for the GPU) and writes it as a
+    // binary PPM, top row first
+    bool writePPM(const std::string& path) const;
+
+private:
+    HeadlessContext(const HeadlessContext&);
+    HeadlessContext& operator=(const HeadlessContext&);
+};
+
+#endif
@@ -0,0 +1,81 @@
+#ifndef HEIGHT_FIELD_H
+#define HEIGHT_FIELD_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include "HeightStream.h"
+#include "ShaderManager.h"
+#include "ShaderVariants.h"
+
+// GPU height field sampled by wave.vert: height and slope in an RGBA16F
+// texture, simulated once per texel independent of the mesh resolution.
+// The analytic waves are rendered straight into it, with slopes from
+// WaveFunction's derivatives. A CPU engine's two latest steps are streamed
+// into R32F textures, and a second pass blends them and derives the slopes
+// by central differences.
+class HeightField {
+private:
+    ShaderVariants* analyticShaders;   // RIPPLES on or off
+    ShaderVariants* gradientShaders;
+    
+    // Replacements being compiled by a hot reload
+    ShaderVariants* pendingAnalyticShaders;
+    ShaderVariants* pendingGradientShaders;
+    GLuint emptyVAO;        // the passes draw a generated triangle
+    GLuint heightTextures[2];     // R32F heights from a CPU engine
+    unsigned heightPublications[2];   // which step each one holds
+    bool heightLoaded[2];
+    GLuint fieldTexture;    // RGBA16F (height, dh/dx, dh/dz)
+    GLuint fieldFBO;
+    int heightSize;
+    int fieldSize;
+    int analyticSize;
+
+    static ShaderVariants* createAnalyticShaders();
+    static ShaderVariants* createGradientShaders();
+    void prepareShaders();
+    void resizeField(int size);
+    void runPass(ShaderManager* shader);
+    int loadHeights(HeightStream& stream, unsigned publication, int keep);
+
+public:
+    HeightField(int analyticSize);
+    ~HeightField();
+
+    bool initialize();
+    
+    // Hot reload: recompiles both programs without blocking, advanced by
+    // pollReload() once a frame until it reports them ready. finishReload()
+    // links them and reports whether every variant built; endReload() then
+    // swaps them in or drops them, so the caller can commit them together
+    // with its own programs
+    void beginReload();
+    bool isReloading() const { return pendingAnalyticShaders != nullptr; }
+    bool pollReload();
+    bool finishReload();
+    void endReload(bool commit);
+
+    // Analytic waves, driven by the Wave block, plus the Ripples block's
+    // ripples when there are any
+    void renderAnalytic(bool ripples);
+
+    // A CPU engine's size * size heights, blended from publication previous
+    // of the stream to current by blend and scaled by the Wave block's
+    // heightScale; the field takes the engine's resolution. Each publication
+    // is copied from the stream once.
+    void upload(HeightStream& stream, unsigned previous, unsigned current, float blend, int size, GLint wrap);
+
+    // Fills the field's mip chain, for samplers that filter between levels
+    void generateMipmaps();
+
+    GLuint getTexture() const { return fieldTexture; }
+    int getSize() const { return fieldSize; }
+    int getAnalyticSize() const { return analyticSize; }
+
+private:
+    HeightField(const HeightField&);
+    HeightField& operator=(const HeightField&);
+};
+
+#endif
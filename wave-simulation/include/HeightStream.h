@@ -0,0 +1,79 @@
+#ifndef HEIGHT_STREAM_H
+#define HEIGHT_STREAM_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <atomic>
+#include <deque>
+#include <stddef.h>
+
+// Streaming upload of a CPU engine's heights. The simulation thread copies
+// each published step, once, into one of REGIONS regions of a pixel unpack
+// buffer that stays mapped for the buffer's lifetime (glBufferStorage with
+// GL_MAP_PERSISTENT_BIT and GL_MAP_COHERENT_BIT), so there is no staging copy
+// and the buffer is never reallocated. The render thread copies a
+// region into a texture once and fences the copy; a region is handed back to
+// the writer only when the GPU has passed its fence. Publication n goes to
+// region n % REGIONS, so the writer can run REGIONS - 2 publications ahead of
+// the last copy the GPU finished before it has to skip one.
+//
+// Without OpenGL 4.4 or ARB_buffer_storage the regions are plain memory,
+// uploaded with glTexSubImage2D, which copies them before returning.
+class HeightStream {
+public:
+    // The step being written, one published but not drawn yet, and up to two
+    // frames of copies in flight at two steps a frame
+    static const unsigned REGIONS = 6;
+
+private:
+    struct Fence {
+        GLsync sync;
+        unsigned retired;   // publications before this are free once signalled
+    };
+
+    GLuint buffer;
+    float* memory;            // mapped buffer, or the fallback's own memory
+    bool persistent;
+    size_t regionFloats;
+    std::atomic<unsigned> retired;   // written by the render thread only
+    unsigned copied;          // one past the newest publication copied
+    unsigned fenced;          // copied when the last fence went in
+    std::deque<Fence> fences;
+
+    void retire(bool makeRoom);
+
+public:
+    HeightStream();
+    ~HeightStream();
+
+    // GL thread: regions of regionFloats heights each
+    void initialize(size_t regionFloats);
+    bool isPersistent() const { return persistent; }
+    size_t getRegionFloats() const { return regionFloats; }
+
+    // Writer side: the region for publication, or nullptr while the render
+    // thread or the GPU may still read the one it would reuse. Publications
+    // are numbered from 0 without gaps.
+    float* region(unsigned publication);
+
+    // Reader side: the heights of a publication, which stay intact until an
+    // endFrame() after its copy
+    const float* heights(unsigned publication) const {
+        return memory + (size_t)(publication % REGIONS) * regionFloats;
+    }
+    // Reader side, on the GL thread: copies a size * size publication into
+    // the texture bound to GL_TEXTURE_2D
+    void copy(unsigned publication, int size);
+    // Once per frame after the copies: fences them and frees the regions of
+    // those the GPU has finished. With makeRoom it waits for the GPU until
+    // the writer's next publication has a region, for callers that step the
+    // writer themselves and must never have it skip one.
+    void endFrame(bool makeRoom);
+
+private:
+    HeightStream(const HeightStream&);
+    HeightStream& operator=(const HeightStream&);
+};
+
+#endif
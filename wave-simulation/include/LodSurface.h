@@ -0,0 +1,71 @@
+#ifndef LOD_SURFACE_H
+#define LOD_SURFACE_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <vector>
+
+// Horizon-wide water surface as a quadtree of equally sized patch grids
+// (continuous distance-dependent LOD, after Strugar's CDLOD). Every frame the
+// tree is walked on the CPU from the camera: a node is refined while the
+// camera is within its level's range, and nodes outside the view frustum
+// are dropped. Each selected node becomes one instance of the same
+// PATCH_RESOLUTION^2 grid, so the whole surface is one instanced draw and
+// the triangle count depends on the LOD ranges, not on the area in view.
+// shaders/patch.glsl morphs each patch into the next coarser level near the
+// end of its range, which closes the cracks between levels.
+class LodSurface {
+public:
+    static const int PATCH_RESOLUTION = 16;   // quads per patch side
+    static const int LEVELS = 10;
+    static const int MAX_PATCHES = 2048;
+
+private:
+    struct Instance {
+        float x, z, size;
+        float morphStart, morphEnd;
+    };
+
+    GLuint VAO;
+    GLuint indexBuffer;      // 16-bit indices of one patch
+    GLuint instanceBuffer;
+    GLuint sampler;          // repeating, mipmapped field sampler
+    int indexCount;
+    std::vector<Instance> instances;
+
+    float rootSize;
+    float ranges[LEVELS];    // camera distance covered by each level, finest first
+    float planes[6][4];      // frustum planes of the current selection
+
+    void extractPlanes(const float* viewProjection);
+    bool isVisible(float x, float z, float size, float heightBound) const;
+    bool withinRange(float x, float z, float size, const float* camera, float range) const;
+    void select(float x, float z, float size, int level, const float* camera, float heightBound);
+    void addPatch(float x, float z, float size, int level);
+
+public:
+    LodSurface();
+    ~LodSurface();
+
+    // rootSize is the side of the area covered, centred on the origin
+    bool initialize(float rootSize);
+
+    // Rebuilds the patch list for a camera at camera[3] seeing through the
+    // column-major viewProjection matrix; heightBound bounds |height| for
+    // culling. Uploads the instances.
+    void update(const float* viewProjection, const float* camera, float heightBound);
+
+    // Draws the patches with the bound program, sampling the field texture
+    // bound to unit 0 with repeat and mipmaps
+    void draw() const;
+
+    int getPatchCount() const { return (int)instances.size(); }
+    int getTriangleCount() const { return (int)instances.size() * PATCH_RESOLUTION * PATCH_RESOLUTION * 2; }
+
+private:
+    LodSurface(const LodSurface&);
+    LodSurface& operator=(const LodSurface&);
+};
+
+#endif
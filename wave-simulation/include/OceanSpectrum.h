@@ -0,0 +1,54 @@
+#ifndef OCEAN_SPECTRUM_H
+#define OCEAN_SPECTRUM_H
+
+#include <vector>
+#include "FFT.h"
+#include "WorkerPool.h"
+
+// Tessendorf ocean: random amplitudes h0(k) are drawn once from a Phillips
+// or JONSWAP spectrum, then every frame they are advanced with the deep-water
+// dispersion relation w = sqrt(g * |k|) and inverse-FFT'd into a periodic
+// height tile. The cost per frame depends only on the grid size, not on how
+// many waves make up the sea.
+class OceanSpectrum {
+public:
+    enum Spectrum { PHILLIPS, JONSWAP };
+
+private:
+    static const float GRAVITY;
+    static const float PATCH_LENGTH;   // metres covered by one tile
+    static const float WIND_SPEED;     // metres per second
+    static const float TARGET_RMS;     // RMS height of the tile in mesh units
+
+    int size;
+    Spectrum spectrum;
+    float windX, windZ;
+
+    // h0(k) and conj(h0(-k)), pre-scaled so the output has TARGET_RMS
+    std::vector<float> h0Re, h0Im;
+    std::vector<float> h0ConjRe, h0ConjIm;
+    std::vector<float> omega;
+
+    FFT2D fft;
+    WorkerPool* pool;
+
+    // h(k, t) before the transform, heights (real part) after it; rows are
+    // fft.getStride() floats apart
+    std::vector<float> re, im;
+
+    float waveNumber(int index) const;
+    float density(float kx, float kz) const;
+    void buildSpectrum();
+
+public:
+    OceanSpectrum(int size, WorkerPool* pool, Spectrum spectrum = PHILLIPS);
+
+    void update(float time);
+
+    const float* getHeights() const { return &re[0]; }
+    int getSize() const { return size; }
+    int getStride() const { return fft.getStride(); }
+    const char* getSpectrumName() const { return spectrum == JONSWAP ? "JONSWAP" : "Phillips"; }
+};
+
+#endif
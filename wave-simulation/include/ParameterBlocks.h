@@ -0,0 +1,39 @@
+#ifndef PARAMETER_BLOCKS_H
+#define PARAMETER_BLOCKS_H
+
+#include "RippleManager.h"
+#include "ShaderManager.h"
+
+// Per-frame parameters shared by every program through std140 uniform
+// blocks. Each struct mirrors the GLSL block of the same name.
+
+static const GLuint CAMERA_BINDING = 1;
+static const GLuint WAVE_BINDING = 2;
+
+// layout(std140) uniform Camera
+struct CameraBlock {
+    float projection[16];
+    float view[16];
+    float viewPos[3];
+    float pad0;
+    float lightPos[3];
+    float pad1;
+};
+
+// layout(std140) uniform Wave
+struct WaveBlock {
+    float time;
+    float waveFrequency;
+    float waveSpeed;
+    float heightScale;
+};
+
+// Points a program's blocks at the shared binding points; blocks the program
+// does not use are skipped
+inline void bindParameterBlocks(const ShaderManager& shader) {
+    shader.bindUniformBlock("Ripples", RippleManager::BINDING);
+    shader.bindUniformBlock("Camera", CAMERA_BINDING);
+    shader.bindUniformBlock("Wave", WAVE_BINDING);
+}
+
+#endif
@@ -0,0 +1,56 @@
+#ifndef RIPPLE_MANAGER_H
+#define RIPPLE_MANAGER_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+
+// Timestamped ripple emitters kept in a fixed-capacity ring and mirrored to
+// the std140 "Ripples" uniform block declared in shaders/ripples.glsl, which
+// the height field pass (heightfield.frag) includes. Ripples only change
+// when one is emitted or expires, so the buffer is re-uploaded only then;
+// the shader derives each ripple's age from the time uniform.
+class RippleManager {
+public:
+    static const int CAPACITY = 64;        // must match MAX_RIPPLES in ripples.glsl
+    static const GLuint BINDING = 0;       // uniform buffer binding point
+    static const float LIFETIME;           // seconds until a ripple is retired
+
+    struct Ripple {
+        float x, z;
+        float startTime;
+        float amplitude;
+    };
+
+private:
+    // std140 image of the uniform block
+    struct Block {
+        float ripples[CAPACITY][4];
+        int count[4];
+    };
+
+    Ripple ring[CAPACITY];
+    int head;
+    int count;
+    bool dirty;
+    GLuint buffer;
+
+public:
+    RippleManager();
+    ~RippleManager();
+
+    void initialize();
+    void emit(float x, float z, float time, float amplitude = 1.0f);
+    void update(float time);
+    void upload();
+    void clear();
+
+    int size() const { return count; }
+    const Ripple& operator[](int i) const { return ring[(head + i) % CAPACITY]; }
+
+private:
+    RippleManager(const RippleManager&);
+    RippleManager& operator=(const RippleManager&);
+};
+
+#endif
@@ -1,7 +1,9 @@
 #ifndef SHADER_MANAGER_H
 #define SHADER_MANAGER_H
 
+#include <map>
 #include <string>
+#include <vector>
 #define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
 #include <GL/glext.h>
@@ -11,20 +13,88 @@ private:
     GLuint programID;
     GLuint vertexShaderID;
     GLuint fragmentShaderID;
+    GLuint tessControlShaderID;
+    GLuint tessEvaluationShaderID;
+    
+    // Optional tessellation stages; both or neither
+    std::string tessControlPath;
+    std::string tessEvaluationPath;
+    
+    // Uniform locations reflected once at link time; names that are not
+    // active are added as -1 on first use so they only warn once
+    mutable std::map<std::string, GLint> uniformLocations;
+    
+    // Directory of linked program binaries; empty disables the cache
+    static std::string cacheDirectory;
+    std::string binaryPath;
+    
+    // Whether GL_KHR_parallel_shader_compile was found and enabled
+    static bool parallelCompile;
 
-    std::string readShaderFile(const std::string& filepath);
+    static std::string readShaderFile(const std::string& filepath);
+    static std::string preprocess(const std::string& filepath, int fileNumber, std::vector<std::string>& included);
+    static std::string injectPrelude(const std::string& source, const std::string& prelude);
     GLuint compileShader(const std::string& source, GLenum shaderType);
-    void checkCompileErrors(GLuint shader, const std::string& type);
-    void checkLinkErrors(GLuint program);
+    bool checkCompileErrors(GLuint shader, const std::string& type);
+    bool checkLinkErrors(GLuint program);
+    void discardPending();
+    std::string cachePath(const std::vector<std::string>& sources);
+    bool loadProgramBinary(const std::string& path);
+    void saveProgramBinary(const std::string& path);
+    void reflectUniforms();
+    GLint findUniform(const std::string& name) const;
 
 public:
     ShaderManager();
     ~ShaderManager();
 
-    bool loadShaders(const std::string& vertexPath, const std::string& fragmentPath);
+    // Sources may #include "file" relative to themselves. Each define is
+    // injected as "#define NAME 1" after the #version line of both stages,
+    // followed by the optional prelude (generated GLSL such as
+    // WaveFunction::glsl()).
+    bool loadShaders(const std::string& vertexPath, const std::string& fragmentPath,
+                     const std::string& prelude = "",
+                     const std::vector<std::string>& defines = std::vector<std::string>());
+    
+    // loadShaders split in two: beginLoad queues the compile and link
+    // without waiting, finishLoad blocks for the result. Beginning several
+    // programs before finishing any lets the driver compile them in parallel.
+    bool beginLoad(const std::string& vertexPath, const std::string& fragmentPath,
+                   const std::string& prelude = "",
+                   const std::vector<std::string>& defines = std::vector<std::string>());
+    bool finishLoad();
+    
+    // beginLoad split again: readSources does all the file work (reading,
+    // #include expansion, defines and prelude) without touching GL, so it
+    // may run on any thread; beginLoad then queues its sources. paths holds
+    // the vertex and fragment stages, then optionally the two tessellation
+    // stages.
+    static bool readSources(const std::vector<std::string>& paths, const std::string& prelude,
+                            const std::vector<std::string>& defines, std::vector<std::string>& sources);
+    bool beginLoad(const std::vector<std::string>& sources);
+    
+    // Adds tessellation control and evaluation stages to the following
+    // loads. They are preprocessed like the other two and share the defines
+    // and prelude; the caller checks that the context supports them.
+    void setTessellationShaders(const std::string& controlPath, const std::string& evaluationPath);
+    
+    // True once finishLoad will not block. Without parallel compilation
+    // support this is always true and finishLoad waits for the driver.
+    bool isReady() const;
+    
+    // Lets the driver use as many compiler threads as it likes; checked
+    // once per run
+    static void enableParallelCompile();
+    static bool isParallelCompile() { return parallelCompile; }
     void use() const;
+    
+    static void setCacheDirectory(const std::string& directory) { cacheDirectory = directory; }
     GLuint getProgramID() const { return programID; }
+    // The cache entry of the program, or empty when the cache is off
+    const std::string& getBinaryPath() const { return binaryPath; }
     
+    void bindUniformBlock(const std::string& name, GLuint binding) const;
+    void setInt(const std::string& name, int value) const;
     void setFloat(const std::string& name, float value) const;
     void setVec2(const std::string& name, float x, float y) const;
     void setVec3(const std::string& name, float x, float y, float z) const;
@@ -0,0 +1,81 @@
+#ifndef SHADER_VARIANTS_H
+#define SHADER_VARIANTS_H
+
+#include <atomic>
+#include <cassert>
+#include <string>
+#include <thread>
+#include <vector>
+#include "ShaderManager.h"
+
+// Every combination of a list of compile-time features of one shader pair.
+// A variant's key has bit i set when features[i] is defined, so each
+// program only contains the code its state needs instead of branching on
+// uniforms. All variants are queued before any is waited on, which lets
+// drivers with GL_KHR_parallel_shader_compile build them concurrently.
+class ShaderVariants {
+private:
+    std::string vertexPath;
+    std::string fragmentPath;
+    std::string tessControlPath;
+    std::string tessEvaluationPath;
+    std::string prelude;
+    std::vector<std::string> features;
+    std::vector<ShaderManager*> programs;   // indexed by key
+
+    // Background builds: the reader thread fills sources (one entry per key)
+    // and then sets sourcesRead; the GL thread submits them in key order
+    std::vector<std::vector<std::string> > sources;
+    std::thread reader;
+    std::atomic<bool> sourcesRead;
+    unsigned int submitted;
+    bool submitOk;
+    std::vector<std::string> cacheEntries;   // binaries the last build linked
+
+    void clear();
+    void readSources();
+    void submit(unsigned int key);
+
+public:
+    ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath,
+                   const std::vector<std::string>& features, const std::string& prelude = "");
+    ~ShaderVariants();
+
+    // Adds tessellation stages to every variant compiled afterwards
+    void setTessellationShaders(const std::string& controlPath, const std::string& evaluationPath);
+
+    // Blocking compile of every variant
+    bool compile();
+    
+    // The same in steps, for rebuilds that must not stall a frame:
+    // beginCompile() reads and preprocesses the sources on a thread of its
+    // own, poll() (never blocks) hands them to the driver and reports when
+    // finishCompile() can collect the results without waiting. With
+    // GL_KHR_parallel_shader_compile every variant is submitted at once;
+    // without it the driver compiles on submission, so poll() submits one
+    // variant per call. A failed set is left empty.
+    void beginCompile();
+    bool poll();
+    bool finishCompile();
+    
+    // Deletes the program binaries this set cached that live, the set in
+    // use, does not share. Call on the set that lost a reload (the replaced
+    // one, or a rebuild that was not swapped in) so edits do not pile up
+    // entries in the cache.
+    void evictCache(const ShaderVariants* live) const;
+
+    // Key bits beyond the feature list are ignored. Only valid on a set that
+    // built: rebuilds go into a separate set that replaces this one on success
+    ShaderManager* get(unsigned int key) const {
+        assert(!programs.empty());
+        return programs[key & (programs.size() - 1)];
+    }
+    int size() const { return (int)programs.size(); }
+    ShaderManager* operator[](int i) const { return programs[i]; }
+
+private:
+    ShaderVariants(const ShaderVariants&);
+    ShaderVariants& operator=(const ShaderVariants&);
+};
+
+#endif
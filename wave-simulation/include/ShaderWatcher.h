@@ -0,0 +1,34 @@
+#ifndef SHADER_WATCHER_H
+#define SHADER_WATCHER_H
+
+#include <chrono>
+#include <string>
+
+// Watches a shader directory with inotify (Linux only; elsewhere start()
+// fails and nothing is reported). Polled from the render loop, so it never
+// blocks: poll() reads whatever events are queued and reports a change once
+// the files have been quiet for SETTLE_MS, which folds an editor's
+// write-then-rename sequence into one reload.
+class ShaderWatcher {
+private:
+    static const int SETTLE_MS = 100;
+
+    int fd;
+    bool changed;
+    std::chrono::steady_clock::time_point lastChange;
+
+    static bool isShaderFile(const char* name);
+
+public:
+    ShaderWatcher();
+    ~ShaderWatcher();
+
+    bool start(const std::string& directory);
+    bool poll();
+
+private:
+    ShaderWatcher(const ShaderWatcher&);
+    ShaderWatcher& operator=(const ShaderWatcher&);
+};
+
+#endif
@@ -0,0 +1,175 @@
+#ifndef SIMULATION_H
+#define SIMULATION_H
+
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "CommandRing.h"
+#include "HeightStream.h"
+#include "OceanSpectrum.h"
+#include "RippleManager.h"
+#include "TripleBuffer.h"
+#include "WaveSolver.h"
+#include "WorkerPool.h"
+
+// Everything that advances with simulated time: the clock, the ripple
+// emitters and the CPU engines. It steps either on its own thread at a
+// fixed rate (start()) or when the caller asks (step(), used by the
+// reproducible headless runs). After every step it publishes an immutable
+// Snapshot through a triple buffer, so the render thread reads the latest
+// state without locks and a slow step never stalls a frame, or a slow frame
+// the clock.
+//
+// Parameter and pointer changes arrive as timestamped commands through a
+// lock-free ring, from one producer thread, and are applied at the start of
+// the next step. The parameters reach the renderer in the snapshots, so
+// every change flows through one replayable stream.
+class Simulation {
+public:
+    enum Mode { MODE_ANALYTIC, MODE_SOLVER, MODE_OCEAN };
+    
+    // Values the shaders read as well as the engines
+    struct Parameters {
+        float waveSpeed;
+        float waveHeight;
+        float waveFrequency;
+    };
+    
+    struct Command {
+        enum Type {
+            SET_WAVE_SPEED, SET_WAVE_HEIGHT, SET_WAVE_FREQUENCY, SET_MODE,
+            POINTER_MOVE, POINTER_PRESS, POINTER_RELEASE
+        };
+        double timestamp;   // Simulation::now() when issued
+        Type type;
+        float x, y;         // the SET_WAVE_* value in x; POINTER_MOVE's position
+                            // in [0, 1] across the surface
+        int mode;           // SET_MODE
+    };
+    
+    static const unsigned COMMAND_CAPACITY = 1024;
+
+    // The state after one step, and the heights published before it, so the
+    // reader can interpolate between the two latest steps
+    struct Snapshot {
+        double publishedAt;      // Simulation::now() when published
+        float previousTime;
+        float time;
+        Mode mode;
+        Parameters parameters;
+        int size;                // heights per side; 0 in analytic mode
+        bool periodic;           // heights tile (the FFT ocean)
+        unsigned heights;        // HeightStream publications of size * size
+        unsigned previousHeights;   // packed rows; the same after a mode change
+        unsigned rippleVersion;  // changes whenever the ripple list does
+        int rippleCount;
+        RippleManager::Ripple ripples[RippleManager::CAPACITY];
+        double stepMilliseconds; // CPU time of every step up to this one; the
+                                 // difference between two snapshots times the
+                                 // steps in between
+
+        Snapshot() : publishedAt(0.0), previousTime(0.0f), time(0.0f), mode(MODE_ANALYTIC),
+                     parameters(), size(0), periodic(false), heights(0), previousHeights(0),
+                     rippleVersion(0), rippleCount(0), stepMilliseconds(0.0) {}
+    };
+
+private:
+    WorkerPool* workerPool;
+    WaveSolver* solver;
+    int solverSize;
+    OceanSpectrum* ocean;
+    int oceanSize;
+    OceanSpectrum::Spectrum oceanSpectrum;
+    float oceanTime;
+    Mode mode;
+    float time;
+
+    // CPU copy of the emitters; never uploaded from this side
+    RippleManager ripples;
+    unsigned rippleVersion;
+    float lastRippleTime;
+
+    // Commands from the input side, drained once per step
+    CommandRing<Command, COMMAND_CAPACITY> commands;
+    Parameters parameters;
+    float pointerU, pointerV;   // [0, 1] across the surface
+    bool pressed;
+    bool clicked;               // pressed since the last step
+
+    // Heights are copied once into the stream's mapped regions
+    HeightStream* heightStream;
+    unsigned publication;       // the next one
+    float publishedTime;
+    Mode lastMode;
+    int lastSize;
+
+    TripleBuffer<Snapshot> snapshots;
+    std::thread thread;
+    std::atomic<bool> running;
+    float stepSeconds;
+    std::atomic<unsigned> stepCount;
+    std::mutex commandMutex;   // held by step() from its drain to its count
+    double stepMilliseconds;   // CPU time of every step so far
+
+    void setMode(Mode newMode);
+    void apply(const Command& command);
+    bool pointerInside() const;
+    void publish();
+    void run();
+
+public:
+    Simulation();
+    ~Simulation();
+
+    // Sizes apply at initialize()
+    void setSolverSize(int size) { solverSize = size; }
+    void setOceanSize(int size) { oceanSize = size; }
+    void setOceanSpectrum(OceanSpectrum::Spectrum spectrum) { oceanSpectrum = spectrum; }
+    // The engines' heights are published through stream, whose regions must
+    // hold getMaxHeightSize()^2 floats; without one, snapshots carry none.
+    // Set before initialize(); it must outlive the thread.
+    void setHeightStream(HeightStream* stream) { heightStream = stream; }
+    int getMaxHeightSize() const { return std::max(solverSize, oceanSize); }
+    void initialize();
+
+    // Advances by deltaTime and publishes; only while the thread is stopped
+    void step(float deltaTime);
+
+    // Steps every stepSeconds of wall-clock time on a thread of its own
+    // until stop() (or destruction)
+    void start(float stepSeconds);
+    void stop();
+    bool isRunning() const { return thread.joinable(); }
+    float getStepSeconds() const { return stepSeconds; }
+    // Steps that have taken their commands. A step may be draining the ring
+    // at any moment, so a command submitted now is applied by step
+    // getStepCount() + 1 or the one after, unless it is submitted between
+    // holdCommands() and releaseCommands(): steps wait for the release
+    // before taking commands, so the count read while holding is exact.
+    unsigned getStepCount() const { return stepCount.load(std::memory_order_acquire); }
+    void holdCommands() { commandMutex.lock(); }
+    void releaseCommands() { commandMutex.unlock(); }
+
+    // Reader side: the newest published snapshot. Call acquire() once per
+    // frame; the reference stays valid until the next call.
+    const Snapshot& acquire();
+
+    // Producer side: queues a command for the next step, stamping it when
+    // its timestamp is 0. False when the ring is full and it was dropped.
+    bool submit(Command command);
+
+    int getThreadCount() const { return workerPool ? workerPool->size() : 0; }
+    const char* getSolverKernelName() const { return solver ? solver->getKernelName() : ""; }
+
+    // Steady clock in seconds, the time base of Snapshot::publishedAt
+    static double now();
+    static Parameters defaultParameters();
+
+private:
+    Simulation(const Simulation&);
+    Simulation& operator=(const Simulation&);
+};
+
+#endif
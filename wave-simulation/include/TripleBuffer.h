@@ -0,0 +1,53 @@
+#ifndef TRIPLE_BUFFER_H
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+// Lock-free hand-over of whole values from one writer thread to one reader
+// thread. The writer fills its back buffer and publishes it; the reader
+// picks up the most recently published one. Each side owns one buffer and
+// the third sits in the middle, so neither ever waits for the other and the
+// reader never sees a buffer being written. Values the reader did not pick
+// up in time are overwritten, never queued.
+template <typename T>
+class TripleBuffer {
+private:
+    static const unsigned INDEX_MASK = 3;
+    static const unsigned FRESH = 4;   // middle holds a value not yet read
+
+    T buffers[3];
+    std::atomic<unsigned> middle;
+    unsigned back;    // writer's
+    unsigned front;   // reader's
+
+public:
+    TripleBuffer() : middle(1), back(0), front(2) {
+    }
+
+    // Writer side
+    T& writeBuffer() { return buffers[back]; }
+
+    // Release orders the writes to the back buffer before the swap. The
+    // buffer handed back may hold any older value.
+    void publish() {
+        back = middle.exchange(back | FRESH, std::memory_order_acq_rel) & INDEX_MASK;
+    }
+
+    // Reader side: switches to the latest published value, returning false
+    // when nothing new was published since the last call
+    bool update() {
+        if (!(middle.load(std::memory_order_relaxed) & FRESH)) {
+            return false;
+        }
+        front = middle.exchange(front, std::memory_order_acq_rel) & INDEX_MASK;
+        return true;
+    }
+
+    const T& readBuffer() const { return buffers[front]; }
+
+private:
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+};
+
+#endif
@@ -0,0 +1,64 @@
+#ifndef UNIFORM_BLOCK_H
+#define UNIFORM_BLOCK_H
+
+#define GL_GLEXT_PROTOTYPES
+#include <GL/gl.h>
+#include <GL/glext.h>
+#include <cstring>
+
+// CPU copy of a std140 uniform block backed by a buffer on a fixed binding
+// point. set() only marks the block dirty when a value actually changed, and
+// upload() sends the whole struct with one glBufferSubData, so unchanged
+// blocks cost nothing per frame. T must mirror the GLSL layout, padding
+// included.
+template <typename T>
+class UniformBlock {
+private:
+    T values;
+    GLuint buffer;
+    GLuint binding;
+    bool dirty;
+
+public:
+    explicit UniformBlock(GLuint binding) : buffer(0), binding(binding), dirty(true) {
+        std::memset(&values, 0, sizeof(values));
+    }
+
+    ~UniformBlock() {
+        if (buffer) glDeleteBuffers(1, &buffer);
+    }
+
+    void initialize() {
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferData(GL_UNIFORM_BUFFER, sizeof(T), &values, GL_DYNAMIC_DRAW);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        glBindBufferBase(GL_UNIFORM_BUFFER, binding, buffer);
+        dirty = false;
+    }
+
+    void set(const T& newValues) {
+        if (std::memcmp(&values, &newValues, sizeof(T)) != 0) {
+            values = newValues;
+            dirty = true;
+        }
+    }
+
+    const T& get() const { return values; }
+
+    void upload() {
+        if (!dirty || !buffer) {
+            return;
+        }
+        glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+        glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(T), &values);
+        glBindBuffer(GL_UNIFORM_BUFFER, 0);
+        dirty = false;
+    }
+
+private:
+    UniformBlock(const UniformBlock&);
+    UniformBlock& operator=(const UniformBlock&);
+};
+
+#endif
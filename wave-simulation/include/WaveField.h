@@ -0,0 +1,100 @@
+#ifndef WAVE_FIELD_H
+#define WAVE_FIELD_H
+
+#include <stddef.h>
+#include "HeightStream.h"
+#include "RippleManager.h"
+#include "Simulation.h"
+#include "WorkerPool.h"
+
+// CPU point queries of the surface being drawn, for objects floating on it.
+// Queries are in the mesh's coordinates, x and z in [-1, 1], and need not
+// lie on the grid.
+//
+// In analytic mode the WaveFunction terms plus the mouse ripples are
+// evaluated exactly as shaders/heightfield.frag and shaders/ripples.glsl do.
+// Batches run 4 or 8 queries at a time with SSE or AVX2 where the CPU has
+// them. In solver and ocean mode the engine's last two published steps are
+// copied from the height stream. They are blended, differenced and
+// interpolated as shaders/gradient.frag and wave.vert do, with the ocean
+// tile repeating and the solver grid clamped.
+//
+// Large batches are split across a thread pool of their own, started by the
+// first batch that needs it.
+class WaveField {
+public:
+    struct Kernel;
+
+    // A ripple as ripples.glsl sees it at the current time; only the live
+    // ones are kept
+    struct ActiveRipple {
+        float x, z;
+        float age;
+        float strength;      // envelope at the origin
+        float strengthRate;  // d(strength)/dt
+        float radius2;       // squared reach beyond which it is skipped
+    };
+
+    // Everything a query depends on, taken from the renderer each frame
+    struct State {
+        Simulation::Mode mode;
+        float time;          // seconds, as in the Wave block
+        float scaledTime;    // time * waveSpeed, the wave function's clock
+        float waveSpeed;
+        float frequency;
+        float heightScale;
+        int rippleCount;
+        ActiveRipple ripples[RippleManager::CAPACITY];
+
+        // Solver and ocean mode: size * size packed rows of each step
+        const float* previous;
+        const float* current;
+        int size;
+        bool periodic;
+        float blend;         // between previous and current, as in gradient.frag
+        float stepRate;      // 1 / seconds between the two steps, 0 if the same
+    };
+
+private:
+    static const size_t TASK_QUERIES = 16384;   // per thread-pool task
+
+    State state;
+    // The CPU copies of the engine's steps, reused while a step stays in use
+    // as HeightField does with its textures
+    float* grids[2];
+    unsigned gridPublications[2];
+    bool gridLoaded[2];
+    int gridSize;
+    int threads;
+    WorkerPool* pool;
+    const Kernel* kernel;
+
+public:
+    // 0 threads means one per hardware thread
+    explicit WaveField(int threads = 0);
+    ~WaveField();
+
+    // The snapshot being drawn, at the renderer's blend between its previous
+    // and latest step. Publications are copied from stream the first time
+    // they appear, before the frame's HeightStream::endFrame() can retire
+    // them; stream may be null when the snapshot is analytic.
+    void setState(const Simulation::Snapshot& snapshot, float blend, HeightStream* stream);
+    Simulation::Mode getMode() const { return state.mode; }
+
+    // Height h and the unit upward normal's x and z components (its y is
+    // sqrt(1 - nx^2 - nz^2)) at n points, plus the vertical velocity dh/dt
+    // in vy when it is not null. Call from one thread at a time.
+    void sample(const float* xs, const float* zs, size_t n, float* h, float* nx, float* nz,
+                float* vy = nullptr);
+
+    const char* getKernelName() const;
+    int getThreadCount() const { return pool ? pool->size() : 1; }
+
+private:
+    const float* loadGrid(HeightStream& stream, unsigned publication, int size, int keep);
+
+    WaveField(const WaveField&);
+    WaveField& operator=(const WaveField&);
+};
+
+#endif
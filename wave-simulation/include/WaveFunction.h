@@ -0,0 +1,139 @@
+#ifndef WAVE_FUNCTION_H
+#define WAVE_FUNCTION_H
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <string>
+
+// The analytic wave surface, shared by the GPU height field and the CPU
+// programs. The surface is a sum of separable terms
+//
+//     amplitude * bx(waveX * f * x + speedX * t) * by(waveY * f * y + speedY * t)
+//
+// with bx, by either sin or cos, f the wave frequency and t the time already
+// scaled by the wave speed. Each term's slopes follow from the chain rule, so
+// height and gradient come out of one evaluation. glsl() emits the same table
+// as a GLSL function, so the shader and the C++ code cannot drift apart.
+namespace WaveFunction {
+
+enum Basis { SIN, COS };
+
+struct Term {
+    float amplitude;
+    float waveX, speedX;
+    Basis basisX;
+    float waveY, speedY;
+    Basis basisY;
+};
+
+static const Term TERMS[] = {
+    { 0.5f, 1.0f, 1.0f, SIN, 1.0f, 0.8f, COS },
+    { 0.3f, 1.7f, 1.3f, SIN, 1.3f, 1.0f, SIN },
+};
+static const int TERM_COUNT = sizeof(TERMS) / sizeof(TERMS[0]);
+
+// Height and its slopes along x and y, in units of the amplitudes
+struct Sample {
+    float height;
+    float dx, dy;
+};
+
+inline float basis(Basis b, float arg) {
+    return b == SIN ? sinf(arg) : cosf(arg);
+}
+
+inline float basisSlope(Basis b, float arg) {
+    return b == SIN ? cosf(arg) : -sinf(arg);
+}
+
+// The x factor of one term; the CPU programs evaluate it once per column
+inline float factorX(const Term& term, float x, float t, float frequency) {
+    return basis(term.basisX, term.waveX * frequency * x + term.speedX * t);
+}
+
+// The y factor of one term, including its amplitude
+inline float factorY(const Term& term, float y, float t, float frequency) {
+    return term.amplitude * basis(term.basisY, term.waveY * frequency * y + term.speedY * t);
+}
+
+inline Sample evaluate(float x, float y, float t, float frequency) {
+    Sample s = { 0.0f, 0.0f, 0.0f };
+    for (int i = 0; i < TERM_COUNT; i++) {
+        const Term& term = TERMS[i];
+        float argX = term.waveX * frequency * x + term.speedX * t;
+        float argY = term.waveY * frequency * y + term.speedY * t;
+        float bx = basis(term.basisX, argX);
+        float by = basis(term.basisY, argY);
+        s.height += term.amplitude * bx * by;
+        s.dx += term.amplitude * term.waveX * frequency * basisSlope(term.basisX, argX) * by;
+        s.dy += term.amplitude * term.waveY * frequency * bx * basisSlope(term.basisY, argY);
+    }
+    return s;
+}
+
+// dh/dt, for time already scaled by the wave speed as above
+inline float rate(float x, float y, float t, float frequency) {
+    float r = 0.0f;
+    for (int i = 0; i < TERM_COUNT; i++) {
+        const Term& term = TERMS[i];
+        float argX = term.waveX * frequency * x + term.speedX * t;
+        float argY = term.waveY * frequency * y + term.speedY * t;
+        r += term.amplitude * (term.speedX * basisSlope(term.basisX, argX) * basis(term.basisY, argY) +
+                               term.speedY * basis(term.basisX, argX) * basisSlope(term.basisY, argY));
+    }
+    return r;
+}
+
+inline float height(float x, float y, float t, float frequency) {
+    float h = 0.0f;
+    for (int i = 0; i < TERM_COUNT; i++) {
+        h += factorX(TERMS[i], x, t, frequency) * factorY(TERMS[i], y, t, frequency);
+    }
+    return h;
+}
+
+// Highest angular wavenumber (radians per unit) along either axis, which
+// sets how finely a mesh must sample the surface
+inline float maxWavenumber(float frequency) {
+    float k = 0.0f;
+    for (int i = 0; i < TERM_COUNT; i++) {
+        k = std::max(k, std::max(TERMS[i].waveX, TERMS[i].waveY) * frequency);
+    }
+    return k;
+}
+
+// GLSL source of
+//     vec3 waveFunction(vec2 p, float t, float frequency)
+// returning (height, dh/dx, dh/dy) exactly as evaluate() does
+inline std::string glsl() {
+    std::ostringstream out;
+    out.setf(std::ios::showpoint);
+    out.precision(7);
+
+    out << "// Generated from the term table in WaveFunction.h\n"
+        << "vec3 waveFunction(vec2 p, float t, float frequency) {\n"
+        << "    vec3 sum = vec3(0.0);\n"
+        << "    vec2 arg, s, c;\n";
+    for (int i = 0; i < TERM_COUNT; i++) {
+        const Term& term = TERMS[i];
+        const char* bx = term.basisX == SIN ? "s.x" : "c.x";
+        const char* by = term.basisY == SIN ? "s.y" : "c.y";
+        const char* slopeX = term.basisX == SIN ? "c.x" : "-s.x";
+        const char* slopeY = term.basisY == SIN ? "c.y" : "-s.y";
+        out << "    arg = vec2(" << term.waveX << ", " << term.waveY << ") * frequency * p + vec2("
+            << term.speedX << ", " << term.speedY << ") * t;\n"
+            << "    s = sin(arg);\n"
+            << "    c = cos(arg);\n"
+            << "    sum += " << term.amplitude << " * vec3(" << bx << " * " << by << ", "
+            << term.waveX << " * frequency * " << slopeX << " * " << by << ", "
+            << term.waveY << " * frequency * " << bx << " * " << slopeY << ");\n";
+    }
+    out << "    return sum;\n"
+        << "}\n";
+    return out.str();
+}
+
+}
+
+#endif
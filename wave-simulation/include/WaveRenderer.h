@@ -5,47 +5,175 @@
 #define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
 #include <GL/glext.h>
+#include "FrameProfiler.h"
+#include "GLDebug.h"
+#include "HeightField.h"
+#include "HeightStream.h"
+#include "LodSurface.h"
+#include "ParameterBlocks.h"
+#include "RippleManager.h"
 #include "ShaderManager.h"
+#include "ShaderVariants.h"
+#include "ShaderWatcher.h"
+#include "Simulation.h"
+#include "UniformBlock.h"
+#include "WaveField.h"
 
 class WaveRenderer {
+public:
+    typedef Simulation::Mode SimulationMode;
+
 private:
-    static const int GRID_SIZE = 100;
-    static const int VERTEX_COUNT = GRID_SIZE * GRID_SIZE;
+    // Surface shader variant keys
+    enum SurfaceFeature { SURFACE_FOAM = 1, SURFACE_FRAGMENT_NORMALS = 2, SURFACE_LOD = 4 };
+    
+    // The mesh has no vertex data: wave.vert derives each vertex from its
+    // ID (shaders/grid.glsl), so the VAO only satisfies the core profile
+    GLuint VAO;
+    int gridSize;            // vertices per side in use
+    int requestedGridSize;   // 0 picks gridSize from the content each frame
+    
+    // Horizon-wide surface for the periodic FFT ocean, in place of the grid
+    LodSurface* lodSurface;
+    bool lod;
+    ShaderVariants* surfaceShaders;
+    ShaderVariants* pendingSurfaceShaders;   // being compiled by a hot reload
+    
+    // Hardware-tessellated surface (OpenGL 4.0): a coarse patch grid that
+    // the GPU subdivides by screen-space size and curvature. Its variants
+    // take the FOAM and FRAGMENT_NORMALS bits of the surface key.
+    ShaderVariants* tessShaders;
+    ShaderVariants* pendingTessShaders;
+    bool tessellationSupported;
+    bool tessellation;
+    GLuint primitivesQuery;    // triangles the tessellator emitted
+    bool primitivesPending;
+    int tessTriangles;
+    ShaderWatcher shaderWatcher;
+    bool reloadRequested;   // an edit arrived while a rebuild was pending
+    bool foam;
+    bool fragmentNormals;
+    
+    // Per-frame parameters shared by all programs
+    UniformBlock<CameraBlock> cameraBlock;
+    UniformBlock<WaveBlock> waveBlock;
     
-    GLuint VAO, VBO, EBO;
-    ShaderManager* shaderManager;
+    // Per-frame height and slope texture: the height field pass evaluates the
+    // waves and ripples into it, and the surface shaders only sample it
+    HeightField* heightField;
+    int fieldSize;
     
-    float* vertices;
-    unsigned int* indices;
-    int indexCount;
+    // Clock, ripples and CPU engines. Each frame draws the latest snapshot
+    // it published, blended towards the one before while its thread runs.
+    // The engines' heights arrive through the stream.
+    Simulation simulation;
+    HeightStream* heightStream;
+    SimulationMode mode;     // of the snapshot being drawn
+    Simulation::Parameters parameters;   // likewise
+    float time;              // likewise, interpolated
+    float blend;             // between the snapshot's previous and latest step
+    int simulatedSize;       // heights per side, 0 for the analytic waves
+    unsigned uploadedRippleVersion;
     
-    float time;
-    float waveSpeed;
-    float waveHeight;
-    float waveFrequency;
+    // Last values submitted, for the UI; frames show them one step later
+    Simulation::Parameters requested;
+    SimulationMode requestedMode;
     
-    // Mouse interaction
-    float mouseX, mouseY;
-    bool mousePressed;
+    RippleManager ripples;   // GPU copy of the snapshot's ripples
+    WaveField waveField;     // CPU queries of the surface being drawn
+    
+    // Optional timing of the simulation steps and the GPU render passes
+    FrameProfiler* profiler;
+    int cpuUpdateSection;
+    double profiledStepMilliseconds;   // the snapshot's at the last frame
+    int gpuHeightFieldSection;
+    int gpuSurfaceSection;
     
-    void generateMesh();
     void setupBuffers();
-    void checkGLError(const std::string& location);
+    int autoGridSize() const;
+    bool isLodActive() const;
+    bool isTessellationActive() const;
+    ShaderVariants* createTessShaders() const;
+    void drawTessellated();
+    const Simulation::Snapshot& applySnapshot();
+    void submit(Simulation::Command::Type type, float x = 0.0f, float y = 0.0f, int newMode = 0);
+    static std::vector<std::string> surfaceFeatures();
+    unsigned int surfaceKey() const;
+    void prepareSurfaceShaders();
+    void pollShaderReload();
 
 public:
     WaveRenderer();
     ~WaveRenderer();
     
     bool initialize();
+    
+    // Steps the simulation by deltaTime on the calling thread, for
+    // reproducible runs; not while the simulation thread is running
     void update(float deltaTime);
+    // Steps it every stepSeconds on its own thread instead; render() then
+    // interpolates between the two latest steps
+    void startSimulation(float stepSeconds) { simulation.start(stepSeconds); }
+    // Simulation steps that have taken their input, for recordings
+    unsigned getStepCount() const { return simulation.getStepCount(); }
+    // Brackets the commands of one input event, so that all of them are
+    // applied by step getStepCount() + 1 (see Simulation::holdCommands)
+    void holdCommands() { simulation.holdCommands(); }
+    void releaseCommands() { simulation.releaseCommands(); }
     void render(int screenWidth, int screenHeight);
     
-    void setMousePosition(float x, float y) { mouseX = x; mouseY = y; }
-    void setMousePressed(bool pressed) { mousePressed = pressed; }
-    void setWaveSpeed(float speed) { waveSpeed = speed; }
-    void setWaveHeight(float height) { waveHeight = height; }
-    void setWaveFrequency(float frequency) { waveFrequency = frequency; }
-    bool loadWaveShaders();
+    // Input and wave parameters are queued as commands for the simulation
+    // and must come from one thread. The getters return the last value set.
+    // The pointer in pixels of a width x height window
+    void setMousePosition(float x, float y, int width, int height);
+    void setMousePressed(bool pressed);
+    void setWaveSpeed(float speed);
+    void setWaveHeight(float height);
+    void setWaveFrequency(float frequency);
+    float getWaveSpeed() const { return requested.waveSpeed; }
+    float getWaveHeight() const { return requested.waveHeight; }
+    float getWaveFrequency() const { return requested.waveFrequency; }
+    // Mesh vertices per side; 0 (the default) chooses the coarsest grid
+    // that still resolves the current surface, see autoGridSize()
+    void setGridSize(int size);
+    int getGridSize() const { return gridSize; }
+    bool isGridSizeAuto() const { return requestedGridSize == 0; }
+    // The LOD surface only applies to the FFT ocean, whose tile repeats
+    void setLod(bool enabled) { lod = enabled; }
+    bool getLod() const { return lod; }
+    // Tessellates the [-1, 1] surface on the GPU instead of drawing the
+    // grid; ignored without OpenGL 4.0 and while the LOD surface is active
+    void setTessellation(bool enabled) { tessellation = enabled; }
+    bool getTessellation() const { return tessellation; }
+    bool isTessellationSupported() const { return tessellationSupported; }
+    // Triangles drawn for the surface in the last frame; tessellated
+    // counts arrive from the GPU a few frames late
+    int getTriangleCount() const;
+    void setFieldSize(int size) { fieldSize = size; }
+    void setSolverSize(int size) { simulation.setSolverSize(size); }
+    void setOceanSize(int size) { simulation.setOceanSize(size); }
+    void setOceanSpectrum(OceanSpectrum::Spectrum spectrum) { simulation.setOceanSpectrum(spectrum); }
+    void setFoam(bool enabled) { foam = enabled; }
+    bool getFoam() const { return foam; }
+    void setFragmentNormals(bool enabled) { fragmentNormals = enabled; }
+    bool getFragmentNormals() const { return fragmentNormals; }
+    // Takes effect at the next simulation step
+    void setSimulationMode(SimulationMode newMode);
+    SimulationMode getSimulationMode() const { return requestedMode; }
+    const char* getSimulationModeName() const;
+    
+    // Heights, normals and velocities of the surface as the last render()
+    // drew it, in any mode, for things floating on it
+    WaveField& getWaveField() { return waveField; }
+    
+    // Graphs the simulation steps as "update" and times the height field and
+    // surface passes on the GPU; call after initialize(), with the profiler
+    // outliving the renderer
+    void setProfiler(FrameProfiler* frameProfiler);
+    
+    // Starts compiling the wave shaders (and the height field's) in the
+    // background; they replace the current programs once all of them link
+    void loadWaveShaders();
 };
 
 #endif
\ No newline at end of file
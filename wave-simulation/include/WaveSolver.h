@@ -0,0 +1,57 @@
+#ifndef WAVE_SOLVER_H
+#define WAVE_SOLVER_H
+
+#include "WorkerPool.h"
+
+// Finite-difference solver for the 2D wave equation on a square grid with
+// fixed edges, so ripples reflect off the border and interfere with each
+// other. Heights live in two buffers: a step writes h(t+1) over h(t-1) and
+// swaps them, which needs no third buffer because each cell of the old
+// buffer is read exactly once, by the cell that overwrites it.
+class WaveSolver {
+public:
+    struct Kernel;
+
+private:
+    static const int TILE_ROWS = 32;      // rows per task, about one L2's worth at 2048 wide
+    static const int TICK_RATE = 60;      // solver ticks per simulated second
+    static const int MAX_TICKS = 8;       // per advance() call, so a slow frame cannot spiral
+
+    int size;
+    int stride;          // floats per row, padded to a multiple of 8
+    float* current;      // h(t)
+    float* previous;     // h(t-1), overwritten with h(t+1) during a step
+    float courant2;      // (c * dt / dx)^2, kept below 0.5 for stability
+    float damping;
+    int substeps;
+    float accumulator;
+    WorkerPool* pool;
+    const Kernel* kernel;
+
+    void stepRows(int begin, int end);
+
+public:
+    WaveSolver(int size, WorkerPool* pool);
+    ~WaveSolver();
+
+    // u, v in [0, 1] across the grid; radius in the same units
+    void addImpulse(float u, float v, float radius, float strength);
+    void step();
+    void advance(float deltaTime);
+    void reset();
+
+    void setCourant(float c);
+    void setDamping(float d) { damping = d; }
+    void setSubsteps(int steps) { substeps = steps < 1 ? 1 : steps; }
+
+    const float* getHeights() const { return current; }
+    int getSize() const { return size; }
+    int getStride() const { return stride; }
+    const char* getKernelName() const;
+
+private:
+    WaveSolver(const WaveSolver&);
+    WaveSolver& operator=(const WaveSolver&);
+};
+
+#endif
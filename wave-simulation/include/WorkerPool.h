@@ -0,0 +1,110 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Persistent worker threads for the CPU engines, shared by wave_simulation
+// and wave_simple. run() hands the same job to every worker, the calling
+// thread joins in, and task indices are claimed from a shared counter until
+// none are left. run() returns only once every task has finished, so it is
+// also the barrier between a step and whatever reads its results.
+class WorkerPool {
+private:
+    std::vector<std::thread> workers;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+    std::function<void(int)> job;
+    std::atomic<int> nextTask;
+    int taskCount;
+    int busyWorkers;
+    unsigned generation;
+    bool stopping;
+
+    void drain() {
+        for (int task = nextTask++; task < taskCount; task = nextTask++) {
+            job(task);
+        }
+    }
+
+    void workerLoop() {
+        unsigned seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                while (!stopping && generation == seen) {
+                    wake.wait(lock);
+                }
+                if (stopping) {
+                    return;
+                }
+                seen = generation;
+            }
+            drain();
+            std::lock_guard<std::mutex> lock(mutex);
+            if (--busyWorkers == 0) {
+                finished.notify_one();
+            }
+        }
+    }
+
+public:
+    // 0 threads means one per hardware thread
+    explicit WorkerPool(int threads = 0)
+        : nextTask(0), taskCount(0), busyWorkers(0), generation(0), stopping(false) {
+        if (threads <= 0) {
+            threads = std::max(1u, std::thread::hardware_concurrency());
+        }
+        for (int i = 1; i < threads; i++) {
+            workers.push_back(std::thread(&WorkerPool::workerLoop, this));
+        }
+    }
+
+    ~WorkerPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (size_t i = 0; i < workers.size(); i++) {
+            workers[i].join();
+        }
+    }
+
+    int size() const { return (int)workers.size() + 1; }
+
+    void run(int tasks, const std::function<void(int)>& fn) {
+        if (workers.empty() || tasks <= 1) {
+            for (int task = 0; task < tasks; task++) {
+                fn(task);
+            }
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            job = fn;
+            taskCount = tasks;
+            nextTask = 0;
+            busyWorkers = (int)workers.size();
+            generation++;
+        }
+        wake.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lock(mutex);
+        while (busyWorkers > 0) {
+            finished.wait(lock);
+        }
+    }
+
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+};
+
+#endif
@@ -0,0 +1,16 @@
+// Uniform blocks shared by all programs; the C++ mirrors are in
+// ParameterBlocks.h
+
+layout(std140) uniform Camera {
+    mat4 projection;
+    mat4 view;
+    vec3 viewPos;
+    vec3 lightPos;
+};
+
+layout(std140) uniform Wave {
+    float time;
+    float waveFrequency;
+    float waveSpeed;
+    float heightScale;
+};
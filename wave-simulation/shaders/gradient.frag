@@ -0,0 +1,32 @@
+#version 330 core
+
+// Scales a CPU engine's heights into world units and adds their slope by
+// central differences. The engine's two latest steps are blended here, so
+// its heights reach the GPU untouched. The sources' wrap mode decides what
+// happens at the edges (clamped for the solver, periodic for the ocean tile).
+
+#include "blocks.glsl"
+
+uniform sampler2D previousHeights;
+uniform sampler2D heights;
+uniform float blend;   // 0 at the previous step, 1 at the latest
+
+// (height, dh/dx, dh/dz) over the [-1, 1] mesh
+out vec4 FragField;
+
+#define HEIGHT(offset) mix(textureOffset(previousHeights, uv, offset).r, textureOffset(heights, uv, offset).r, blend)
+
+void main() {
+    vec2 size = vec2(textureSize(heights, 0));
+    vec2 uv = gl_FragCoord.xy / size;
+
+    float h = HEIGHT(ivec2(0, 0));
+    float left = HEIGHT(ivec2(-1, 0));
+    float right = HEIGHT(ivec2(1, 0));
+    float down = HEIGHT(ivec2(0, -1));
+    float up = HEIGHT(ivec2(0, 1));
+
+    // Neighbouring texels are 2 / size apart on the mesh
+    vec2 slope = vec2(right - left, up - down) * size * 0.25;
+    FragField = vec4(h, slope, 0.0) * heightScale;
+}
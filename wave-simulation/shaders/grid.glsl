@@ -0,0 +1,12 @@
+// The surface mesh, generated from the vertex and instance IDs instead of a
+// vertex buffer. Instance i is the triangle strip between grid rows i and
+// i + 1, drawn with glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0,
+// 2 * gridSize, gridSize - 1); even vertices lie on row i, odd ones on i + 1.
+
+uniform int gridSize;
+
+// Grid position in [-1, 1]^2 (x, z)
+vec2 gridPosition() {
+    ivec2 cell = ivec2(gl_VertexID >> 1, gl_InstanceID + (gl_VertexID & 1));
+    return vec2(cell) * (2.0 / float(gridSize - 1)) - 1.0;
+}
@@ -0,0 +1,27 @@
+#version 330 core
+
+// Analytic wave height and slope, one evaluation per texel, written straight
+// into the field texture. Texel centres map onto the [-1, 1] mesh the same
+// way wave.vert samples the field. waveFunction() is generated from
+// WaveFunction.h and injected by HeightField.
+//
+// Features: RIPPLES adds the mouse ripples.
+
+#include "blocks.glsl"
+#ifdef RIPPLES
+#include "ripples.glsl"
+#endif
+
+uniform vec2 fieldSize;
+
+// (height, dh/dx, dh/dz) over the [-1, 1] mesh
+out vec4 FragField;
+
+void main() {
+    vec2 p = gl_FragCoord.xy / fieldSize * 2.0 - 1.0;
+    vec3 wave = waveFunction(p, time * waveSpeed, waveFrequency);
+#ifdef RIPPLES
+    wave += rippleSum(p);
+#endif
+    FragField = vec4(wave, 0.0) * heightScale;
+}
@@ -0,0 +1,29 @@
+// A quadtree patch of the LOD surface (LodSurface.h), one per instance. The
+// patch is a patchResolution x patchResolution quad grid drawn from a shared
+// 16-bit index buffer with no vertex buffer, so gl_VertexID is the vertex
+// number within the patch.
+//
+// Towards the far end of its LOD range a patch morphs its odd rows and
+// columns onto their even neighbours, so at the range boundary it matches
+// the next coarser level exactly and no cracks open between levels.
+
+layout(location = 0) in vec3 patchRect;    // origin x, origin z, size
+layout(location = 1) in vec2 morphRange;   // camera distances where morphing starts and ends
+
+uniform int patchResolution;   // quads per side
+
+// World position (x, z) of the vertex, and the spacing of the vertices
+// around it (which grows towards the coarser level's as the patch morphs)
+vec2 patchPosition(out float spacing) {
+    int side = patchResolution + 1;
+    vec2 grid = vec2(gl_VertexID % side, gl_VertexID / side);
+    float cell = patchRect.z / float(patchResolution);
+
+    vec2 pos = patchRect.xy + grid * cell;
+    float distance = length(vec3(pos.x, 0.0, pos.y) - viewPos);
+    float morph = clamp((distance - morphRange.x) / (morphRange.y - morphRange.x), 0.0, 1.0);
+    grid -= fract(grid * 0.5) * 2.0 * morph;
+
+    spacing = cell * (1.0 + morph);
+    return patchRect.xy + grid * cell;
+}
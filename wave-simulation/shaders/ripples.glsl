@@ -0,0 +1,31 @@
+#include "blocks.glsl"
+
+// Mouse ripples emitted by RippleManager: xy = origin, z = start time,
+// w = amplitude. rippleInfo.x is the live count.
+#define MAX_RIPPLES 64
+#define RIPPLE_LIFETIME 4.0
+#define RIPPLE_EPSILON 0.001
+layout(std140) uniform Ripples {
+    vec4 ripples[MAX_RIPPLES];
+    ivec4 rippleInfo;
+};
+
+// Height and radial slope of all ripples, each fading out over its lifetime
+// and skipped beyond the radius where its envelope drops below RIPPLE_EPSILON
+vec3 rippleSum(vec2 p) {
+    vec3 sum = vec3(0.0);
+    for (int i = 0; i < rippleInfo.x; i++) {
+        vec4 r = ripples[i];
+        float age = time - r.z;
+        float strength = 0.5 * r.w * (1.0 - age / RIPPLE_LIFETIME);
+        if (age < 0.0 || strength <= RIPPLE_EPSILON) continue;
+        vec2 offset = p - r.xy;
+        float dist = length(offset);
+        if (dist > 0.5 * log(strength / RIPPLE_EPSILON)) continue;
+        float phase = dist * 10.0 - age * 8.0;
+        float envelope = exp(-dist * 2.0) * strength;
+        float slope = envelope * (10.0 * cos(phase) - 2.0 * sin(phase));
+        sum += vec3(sin(phase) * envelope, offset / max(dist, 1e-6) * slope);
+    }
+    return sum;
+}
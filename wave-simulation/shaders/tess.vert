@@ -0,0 +1,18 @@
+#version 400 core
+
+// Corners of the coarse patch grid tessellated by tess.tesc and tess.tese.
+// Drawn with glDrawArrays(GL_PATCHES, 0, 4 * patchCount * patchCount) and
+// four vertices per patch, without vertex data: vertex i is corner i % 4 of
+// patch i / 4, counter-clockwise from the patch's (-x, -z) corner.
+
+uniform int patchCount;   // patches per side of [-1, 1]
+
+out vec2 vGrid;
+
+void main() {
+    int patchIndex = gl_VertexID >> 2;
+    int corner = gl_VertexID & 3;
+    ivec2 cell = ivec2(patchIndex % patchCount, patchIndex / patchCount);
+    ivec2 offset = ivec2(corner == 1 || corner == 2 ? 1 : 0, corner >> 1);
+    vGrid = vec2(cell + offset) * (2.0 / float(patchCount)) - 1.0;
+}
@@ -1,10 +1,9 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
-
-uniform mat4 projection;
-uniform mat4 view;
+#include "blocks.glsl"
+#include "grid.glsl"
 
 void main() {
-    gl_Position = projection * view * vec4(aPos * 2.0, 1.0);
+    vec2 grid = gridPosition();
+    gl_Position = projection * view * vec4(grid.x * 2.0, 0.0, grid.y * 2.0, 1.0);
 }
\ No newline at end of file
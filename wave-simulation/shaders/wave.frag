@@ -1,38 +1,50 @@
 #version 330 core
 
+// Features: FOAM whitens the wave peaks; FRAGMENT_NORMALS samples the
+// surface slope per pixel from the height field.
+
 in vec3 FragPos;
+#ifdef FRAGMENT_NORMALS
+uniform sampler2D heightField;
+#else
 in vec3 Normal;
+#endif
 in float Height;
 
 out vec4 FragColor;
 
-uniform vec3 lightPos;
-uniform vec3 viewPos;
-uniform float time;
+#include "blocks.glsl"
 
 void main() {
     // Water colors
     vec3 deepColor = vec3(0.1, 0.3, 0.6);
     vec3 shallowColor = vec3(0.2, 0.6, 0.9);
-    vec3 foamColor = vec3(0.9, 0.95, 1.0);
     
     // Mix colors based on height (normalize height to reasonable range)
     float heightFactor = clamp((Height + 0.5) * 1.0, 0.0, 1.0);
     vec3 waterColor = mix(deepColor, shallowColor, heightFactor);
     
-    // Add foam on wave peaks - adjusted for actual height ranges
-    if (Height > 0.1) {
-        float foamFactor = smoothstep(0.1, 0.3, Height);
-        waterColor = mix(waterColor, foamColor, foamFactor * 0.5);
-    }
+#ifdef FOAM
+    // Foam on wave peaks; smoothstep is zero below 0.1, so no branch is needed
+    vec3 foamColor = vec3(0.9, 0.95, 1.0);
+    float foamFactor = smoothstep(0.1, 0.3, Height);
+    waterColor = mix(waterColor, foamColor, foamFactor * 0.5);
+#endif
+    
+#ifdef FRAGMENT_NORMALS
+    vec2 slope = texture(heightField, FragPos.xz * 0.5 + 0.5).gb;
+    vec3 normal = normalize(vec3(slope.x, -1.0, slope.y));
+#else
+    vec3 normal = normalize(Normal);
+#endif
     
     // Lighting
     vec3 lightDir = normalize(lightPos - FragPos);
     vec3 viewDir = normalize(viewPos - FragPos);
-    vec3 reflectDir = reflect(-lightDir, normalize(Normal));
+    vec3 reflectDir = reflect(-lightDir, normal);
     
     // Diffuse - ensure it's always positive
-    float diff = max(dot(normalize(Normal), lightDir), 0.2); // minimum ambient
+    float diff = max(dot(normal, lightDir), 0.2); // minimum ambient
     vec3 diffuse = diff * vec3(1.0);
     
     // Specular
@@ -40,7 +52,7 @@ void main() {
     vec3 specular = spec * vec3(1.0) * 0.3;
     
     // Fresnel effect
-    float fresnel = pow(1.0 - max(dot(viewDir, normalize(Normal)), 0.0), 2.0);
+    float fresnel = pow(1.0 - max(dot(viewDir, normal), 0.0), 2.0);
     waterColor = mix(waterColor, vec3(0.8, 0.9, 1.0), fresnel * 0.3);
     
     // Combine - ensure minimum brightness
@@ -1,67 +1,49 @@
 #version 330 core
 
-layout(location = 0) in vec3 aPos;
+// Features: FRAGMENT_NORMALS leaves the normal to wave.frag, which samples
+// the field per pixel instead of interpolating per-vertex normals. LOD draws
+// the patches of the LOD surface instead of the [-1, 1] grid; the field then
+// repeats every 2 units and is sampled from a mip level matching the vertex
+// spacing, so distant coarse patches do not alias.
 
-uniform mat4 projection;
-uniform mat4 view;
-uniform float time;
-uniform vec2 mousePos;
-uniform float mousePressed;
-uniform float waveHeight;
-uniform float waveFrequency;
-uniform float waveSpeed;
+#include "blocks.glsl"
+#ifdef LOD
+#include "patch.glsl"
+#else
+#include "grid.glsl"
+#endif
+
+// Height and slope of the surface, rendered once per frame by HeightField:
+// r = height, g = dh/dx, b = dh/dz
+uniform sampler2D heightField;
 
 out vec3 FragPos;
+#ifndef FRAGMENT_NORMALS
 out vec3 Normal;
+#endif
 out float Height;
 
 void main() {
-    vec3 pos = aPos;
-    
-    // Base wave pattern
-    float wave1 = sin(pos.x * waveFrequency + time * waveSpeed) * cos(pos.z * waveFrequency + time * waveSpeed * 0.8);
-    float wave2 = sin(pos.x * waveFrequency * 1.7 + time * waveSpeed * 1.3) * sin(pos.z * waveFrequency * 1.3 + time * waveSpeed);
-    
-    // Mouse interaction wave
-    float mouseDist = distance(pos.xz, mousePos);
-    float mouseWave = 0.0;
-    if (mousePressed > 0.5) {
-        mouseWave = sin(mouseDist * 10.0 - time * 8.0) * exp(-mouseDist * 2.0) * 0.5;
-    }
-    
-    // Combine waves
-    pos.y = (wave1 * 0.5 + wave2 * 0.3 + mouseWave) * waveHeight;
-    
-    // Calculate normal (approximate)
-    float delta = 0.01;
-    vec3 neighborX = vec3(pos.x + delta, 0.0, pos.z);
-    vec3 neighborZ = vec3(pos.x, 0.0, pos.z + delta);
-    
-    // Recalculate heights for neighbors (including mouse wave)
-    float waveX1 = sin(neighborX.x * waveFrequency + time * waveSpeed) * cos(neighborX.z * waveFrequency + time * waveSpeed * 0.8);
-    float waveX2 = sin(neighborX.x * waveFrequency * 1.7 + time * waveSpeed * 1.3) * sin(neighborX.z * waveFrequency * 1.3 + time * waveSpeed);
-    float mouseWaveX = 0.0;
-    if (mousePressed > 0.5) {
-        float mouseDistX = distance(neighborX.xz, mousePos);
-        mouseWaveX = sin(mouseDistX * 10.0 - time * 8.0) * exp(-mouseDistX * 2.0) * 0.5;
-    }
-    neighborX.y = (waveX1 * 0.5 + waveX2 * 0.3 + mouseWaveX) * waveHeight;
-    
-    float waveZ1 = sin(neighborZ.x * waveFrequency + time * waveSpeed) * cos(neighborZ.z * waveFrequency + time * waveSpeed * 0.8);
-    float waveZ2 = sin(neighborZ.x * waveFrequency * 1.7 + time * waveSpeed * 1.3) * sin(neighborZ.z * waveFrequency * 1.3 + time * waveSpeed);
-    float mouseWaveZ = 0.0;
-    if (mousePressed > 0.5) {
-        float mouseDistZ = distance(neighborZ.xz, mousePos);
-        mouseWaveZ = sin(mouseDistZ * 10.0 - time * 8.0) * exp(-mouseDistZ * 2.0) * 0.5;
-    }
-    neighborZ.y = (waveZ1 * 0.5 + waveZ2 * 0.3 + mouseWaveZ) * waveHeight;
-    
-    vec3 tangentX = neighborX - pos;
-    vec3 tangentZ = neighborZ - pos;
-    Normal = normalize(cross(tangentX, tangentZ));
-    
+    // The field spans [-1, 1]
+#ifdef LOD
+    float spacing;
+    vec2 grid = patchPosition(spacing);
+    float texelsPerVertex = spacing * 0.5 * float(textureSize(heightField, 0).x);
+    vec4 field = textureLod(heightField, grid * 0.5 + 0.5, max(log2(texelsPerVertex), 0.0));
+#else
+    vec2 grid = gridPosition();
+    vec4 field = texture(heightField, grid * 0.5 + 0.5);
+#endif
+
+    vec3 pos = vec3(grid.x, field.r, grid.y);
+
+#ifndef FRAGMENT_NORMALS
+    // Same orientation as the cross product of the x and z tangents
+    Normal = normalize(vec3(field.g, -1.0, field.b));
+#endif
+
     FragPos = pos;
     Height = pos.y;
-    
+
     gl_Position = projection * view * vec4(pos, 1.0);
-}
\ No newline at end of file
+}
@@ -0,0 +1,356 @@
+#include "FFT.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+FFT::FFT(int size) : n(size), reversed(size) {
+    int bits = 0;
+    while ((1 << bits) < n) {
+        bits++;
+    }
+    for (int i = 0; i < n; i++) {
+        int r = 0;
+        for (int b = 0; b < bits; b++) {
+            r |= ((i >> b) & 1) << (bits - 1 - b);
+        }
+        reversed[i] = r;
+    }
+
+    // Forward twiddles W_len^j = exp(-2*pi*i*j/len). A radix-2 stage of span
+    // 'half' stores W_{2*half}^j; a radix-4 stage stores W_{2*half}^j followed
+    // by W_{4*half}^j, for j < half.
+    int half = 1;
+    if (bits % 2 == 1) {
+        Stage stage = { half, false, twiddleRe.size() };
+        for (int j = 0; j < half; j++) {
+            twiddleRe.push_back((float)std::cos(-M_PI * j / half));
+            twiddleIm.push_back((float)std::sin(-M_PI * j / half));
+        }
+        stages.push_back(stage);
+        half *= 2;
+    }
+    while (half < n) {
+        Stage stage = { half, true, twiddleRe.size() };
+        for (int j = 0; j < half; j++) {
+            twiddleRe.push_back((float)std::cos(-M_PI * j / half));
+            twiddleIm.push_back((float)std::sin(-M_PI * j / half));
+        }
+        for (int j = 0; j < half; j++) {
+            twiddleRe.push_back((float)std::cos(-M_PI * j / (2 * half)));
+            twiddleIm.push_back((float)std::sin(-M_PI * j / (2 * half)));
+        }
+        stages.push_back(stage);
+        half *= 4;
+    }
+}
+
+void FFT::permute(float* re, float* im) const {
+    for (int i = 0; i < n; i++) {
+        int r = reversed[i];
+        if (i < r) {
+            std::swap(re[i], re[r]);
+            std::swap(im[i], im[r]);
+        }
+    }
+}
+
+static void radix2(float* re, float* im, int n, int half, const float* wr, const float* wi) {
+    for (int k = 0; k < n; k += 2 * half) {
+        float* ar = re + k;
+        float* ai = im + k;
+        float* br = ar + half;
+        float* bi = ai + half;
+        for (int j = 0; j < half; j++) {
+            float tr = br[j] * wr[j] - bi[j] * wi[j];
+            float ti = br[j] * wi[j] + bi[j] * wr[j];
+            br[j] = ar[j] - tr;
+            bi[j] = ai[j] - ti;
+            ar[j] += tr;
+            ai[j] += ti;
+        }
+    }
+}
+
+// Two radix-2 steps fused: spans 'half' and 2 * 'half' over blocks of
+// 4 * 'half'. The second step's twiddle for the upper pair is
+// W_{4h}^(j+h) = W_{4h}^j * -i.
+static void radix4Scalar(float* re, float* im, int n, int half,
+                         const float* w1r, const float* w1i, const float* w2r, const float* w2i) {
+    for (int k = 0; k < n; k += 4 * half) {
+        for (int j = 0; j < half; j++) {
+            int a = k + j, b = a + half, c = b + half, d = c + half;
+
+            float bpr = re[b] * w1r[j] - im[b] * w1i[j];
+            float bpi = re[b] * w1i[j] + im[b] * w1r[j];
+            float dpr = re[d] * w1r[j] - im[d] * w1i[j];
+            float dpi = re[d] * w1i[j] + im[d] * w1r[j];
+
+            float a1r = re[a] + bpr, a1i = im[a] + bpi;
+            float b1r = re[a] - bpr, b1i = im[a] - bpi;
+            float c1r = re[c] + dpr, c1i = im[c] + dpi;
+            float d1r = re[c] - dpr, d1i = im[c] - dpi;
+
+            float cpr = c1r * w2r[j] - c1i * w2i[j];
+            float cpi = c1r * w2i[j] + c1i * w2r[j];
+            float dqr = d1r * w2r[j] - d1i * w2i[j];
+            float dqi = d1r * w2i[j] + d1i * w2r[j];
+            // multiply by -i
+            float tr = dqi;
+            float ti = -dqr;
+
+            re[a] = a1r + cpr; im[a] = a1i + cpi;
+            re[c] = a1r - cpr; im[c] = a1i - cpi;
+            re[b] = b1r + tr;  im[b] = b1i + ti;
+            re[d] = b1r - tr;  im[d] = b1i - ti;
+        }
+    }
+}
+
+#if defined(__SSE2__)
+static inline void complexMul(__m128 ar, __m128 ai, __m128 br, __m128 bi, __m128& outR, __m128& outI) {
+    outR = _mm_sub_ps(_mm_mul_ps(ar, br), _mm_mul_ps(ai, bi));
+    outI = _mm_add_ps(_mm_mul_ps(ar, bi), _mm_mul_ps(ai, br));
+}
+
+static void radix4SSE(float* re, float* im, int n, int half,
+                      const float* w1r, const float* w1i, const float* w2r, const float* w2i) {
+    for (int k = 0; k < n; k += 4 * half) {
+        for (int j = 0; j < half; j += 4) {
+            int a = k + j, b = a + half, c = b + half, d = c + half;
+            __m128 tw1r = _mm_loadu_ps(w1r + j), tw1i = _mm_loadu_ps(w1i + j);
+            __m128 tw2r = _mm_loadu_ps(w2r + j), tw2i = _mm_loadu_ps(w2i + j);
+
+            __m128 ar = _mm_loadu_ps(re + a), ai = _mm_loadu_ps(im + a);
+            __m128 cr = _mm_loadu_ps(re + c), ci = _mm_loadu_ps(im + c);
+            __m128 bpr, bpi, dpr, dpi;
+            complexMul(_mm_loadu_ps(re + b), _mm_loadu_ps(im + b), tw1r, tw1i, bpr, bpi);
+            complexMul(_mm_loadu_ps(re + d), _mm_loadu_ps(im + d), tw1r, tw1i, dpr, dpi);
+
+            __m128 a1r = _mm_add_ps(ar, bpr), a1i = _mm_add_ps(ai, bpi);
+            __m128 b1r = _mm_sub_ps(ar, bpr), b1i = _mm_sub_ps(ai, bpi);
+            __m128 c1r = _mm_add_ps(cr, dpr), c1i = _mm_add_ps(ci, dpi);
+            __m128 d1r = _mm_sub_ps(cr, dpr), d1i = _mm_sub_ps(ci, dpi);
+
+            __m128 cpr, cpi, dqr, dqi;
+            complexMul(c1r, c1i, tw2r, tw2i, cpr, cpi);
+            complexMul(d1r, d1i, tw2r, tw2i, dqr, dqi);
+            // multiply by -i
+            __m128 tr = dqi;
+            __m128 ti = _mm_sub_ps(_mm_setzero_ps(), dqr);
+
+            _mm_storeu_ps(re + a, _mm_add_ps(a1r, cpr)); _mm_storeu_ps(im + a, _mm_add_ps(a1i, cpi));
+            _mm_storeu_ps(re + c, _mm_sub_ps(a1r, cpr)); _mm_storeu_ps(im + c, _mm_sub_ps(a1i, cpi));
+            _mm_storeu_ps(re + b, _mm_add_ps(b1r, tr));  _mm_storeu_ps(im + b, _mm_add_ps(b1i, ti));
+            _mm_storeu_ps(re + d, _mm_sub_ps(b1r, tr));  _mm_storeu_ps(im + d, _mm_sub_ps(b1i, ti));
+        }
+    }
+}
+#endif
+
+void FFT::forward(float* re, float* im) const {
+    permute(re, im);
+    for (size_t s = 0; s < stages.size(); s++) {
+        const Stage& stage = stages[s];
+        const float* wr = &twiddleRe[stage.twiddles];
+        const float* wi = &twiddleIm[stage.twiddles];
+        if (!stage.radix4) {
+            radix2(re, im, n, stage.half, wr, wi);
+            continue;
+        }
+#if defined(__SSE2__)
+        if (stage.half >= 4) {
+            radix4SSE(re, im, n, stage.half, wr, wi, wr + stage.half, wi + stage.half);
+            continue;
+        }
+#endif
+        radix4Scalar(re, im, n, stage.half, wr, wi, wr + stage.half, wi + stage.half);
+    }
+}
+
+void FFT::inverse(float* re, float* im) const {
+    // inverse(x) = conj(forward(conj(x)))
+    for (int i = 0; i < n; i++) {
+        im[i] = -im[i];
+    }
+    forward(re, im);
+    for (int i = 0; i < n; i++) {
+        im[i] = -im[i];
+    }
+}
+
+// Column-pass butterflies: each operand is a row segment of 'width' floats
+// and the twiddle is the same for the whole segment.
+static void radix2Columns(float* ar, float* ai, float* br, float* bi, int width, float wr, float wi) {
+    int c = 0;
+#if defined(__SSE2__)
+    __m128 vwr = _mm_set1_ps(wr), vwi = _mm_set1_ps(wi);
+    for (; c + 4 <= width; c += 4) {
+        __m128 xr = _mm_loadu_ps(br + c), xi = _mm_loadu_ps(bi + c);
+        __m128 tr, ti;
+        complexMul(xr, xi, vwr, vwi, tr, ti);
+        __m128 yr = _mm_loadu_ps(ar + c), yi = _mm_loadu_ps(ai + c);
+        _mm_storeu_ps(br + c, _mm_sub_ps(yr, tr)); _mm_storeu_ps(bi + c, _mm_sub_ps(yi, ti));
+        _mm_storeu_ps(ar + c, _mm_add_ps(yr, tr)); _mm_storeu_ps(ai + c, _mm_add_ps(yi, ti));
+    }
+#endif
+    for (; c < width; c++) {
+        float tr = br[c] * wr - bi[c] * wi;
+        float ti = br[c] * wi + bi[c] * wr;
+        br[c] = ar[c] - tr;
+        bi[c] = ai[c] - ti;
+        ar[c] += tr;
+        ai[c] += ti;
+    }
+}
+
+static void radix4Columns(float* re, float* im, size_t a, size_t b, size_t c, size_t d, int width,
+                          float w1r, float w1i, float w2r, float w2i) {
+    int col = 0;
+#if defined(__SSE2__)
+    __m128 tw1r = _mm_set1_ps(w1r), tw1i = _mm_set1_ps(w1i);
+    __m128 tw2r = _mm_set1_ps(w2r), tw2i = _mm_set1_ps(w2i);
+    for (; col + 4 <= width; col += 4) {
+        __m128 ar = _mm_loadu_ps(re + a + col), ai = _mm_loadu_ps(im + a + col);
+        __m128 cr = _mm_loadu_ps(re + c + col), ci = _mm_loadu_ps(im + c + col);
+        __m128 bpr, bpi, dpr, dpi;
+        complexMul(_mm_loadu_ps(re + b + col), _mm_loadu_ps(im + b + col), tw1r, tw1i, bpr, bpi);
+        complexMul(_mm_loadu_ps(re + d + col), _mm_loadu_ps(im + d + col), tw1r, tw1i, dpr, dpi);
+
+        __m128 a1r = _mm_add_ps(ar, bpr), a1i = _mm_add_ps(ai, bpi);
+        __m128 b1r = _mm_sub_ps(ar, bpr), b1i = _mm_sub_ps(ai, bpi);
+        __m128 c1r = _mm_add_ps(cr, dpr), c1i = _mm_add_ps(ci, dpi);
+        __m128 d1r = _mm_sub_ps(cr, dpr), d1i = _mm_sub_ps(ci, dpi);
+
+        __m128 cpr, cpi, dqr, dqi;
+        complexMul(c1r, c1i, tw2r, tw2i, cpr, cpi);
+        complexMul(d1r, d1i, tw2r, tw2i, dqr, dqi);
+        __m128 tr = dqi;
+        __m128 ti = _mm_sub_ps(_mm_setzero_ps(), dqr);
+
+        _mm_storeu_ps(re + a + col, _mm_add_ps(a1r, cpr)); _mm_storeu_ps(im + a + col, _mm_add_ps(a1i, cpi));
+        _mm_storeu_ps(re + c + col, _mm_sub_ps(a1r, cpr)); _mm_storeu_ps(im + c + col, _mm_sub_ps(a1i, cpi));
+        _mm_storeu_ps(re + b + col, _mm_add_ps(b1r, tr));  _mm_storeu_ps(im + b + col, _mm_add_ps(b1i, ti));
+        _mm_storeu_ps(re + d + col, _mm_sub_ps(b1r, tr));  _mm_storeu_ps(im + d + col, _mm_sub_ps(b1i, ti));
+    }
+#endif
+    for (; col < width; col++) {
+        float bpr = re[b + col] * w1r - im[b + col] * w1i;
+        float bpi = re[b + col] * w1i + im[b + col] * w1r;
+        float dpr = re[d + col] * w1r - im[d + col] * w1i;
+        float dpi = re[d + col] * w1i + im[d + col] * w1r;
+
+        float a1r = re[a + col] + bpr, a1i = im[a + col] + bpi;
+        float b1r = re[a + col] - bpr, b1i = im[a + col] - bpi;
+        float c1r = re[c + col] + dpr, c1i = im[c + col] + dpi;
+        float d1r = re[c + col] - dpr, d1i = im[c + col] - dpi;
+
+        float cpr = c1r * w2r - c1i * w2i;
+        float cpi = c1r * w2i + c1i * w2r;
+        float tr = d1r * w2i + d1i * w2r;
+        float ti = -(d1r * w2r - d1i * w2i);
+
+        re[a + col] = a1r + cpr; im[a + col] = a1i + cpi;
+        re[c + col] = a1r - cpr; im[c + col] = a1i - cpi;
+        re[b + col] = b1r + tr;  im[b + col] = b1i + ti;
+        re[d + col] = b1r - tr;  im[d + col] = b1i - ti;
+    }
+}
+
+void FFT::forwardColumns(float* re, float* im, size_t stride, int width) const {
+    for (int i = 0; i < n; i++) {
+        int r = reversed[i];
+        if (i < r) {
+            std::swap_ranges(re + i * stride, re + i * stride + width, re + r * stride);
+            std::swap_ranges(im + i * stride, im + i * stride + width, im + r * stride);
+        }
+    }
+
+    for (size_t s = 0; s < stages.size(); s++) {
+        const Stage& stage = stages[s];
+        const float* wr = &twiddleRe[stage.twiddles];
+        const float* wi = &twiddleIm[stage.twiddles];
+        int half = stage.half;
+        if (!stage.radix4) {
+            for (int k = 0; k < n; k += 2 * half) {
+                for (int j = 0; j < half; j++) {
+                    size_t a = (k + j) * stride;
+                    size_t b = a + half * stride;
+                    radix2Columns(re + a, im + a, re + b, im + b, width, wr[j], wi[j]);
+                }
+            }
+            continue;
+        }
+        for (int k = 0; k < n; k += 4 * half) {
+            for (int j = 0; j < half; j++) {
+                size_t a = (k + j) * stride;
+                size_t b = a + half * stride;
+                size_t c = b + half * stride;
+                size_t d = c + half * stride;
+                radix4Columns(re, im, a, b, c, d, width, wr[j], wi[j], wr[half + j], wi[half + j]);
+            }
+        }
+    }
+}
+
+void FFT::inverseColumns(float* re, float* im, size_t stride, int width) const {
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < width; c++) {
+            im[i * stride + c] = -im[i * stride + c];
+        }
+    }
+    forwardColumns(re, im, stride, width);
+    for (int i = 0; i < n; i++) {
+        for (int c = 0; c < width; c++) {
+            im[i * stride + c] = -im[i * stride + c];
+        }
+    }
+}
+
+FFT2D::FFT2D(int size, WorkerPool* pool) : fft(size), pool(pool), n(size), stride(size + PAD) {
+}
+
+void FFT2D::transformRows(float* re, float* im, bool inverse) {
+    const int rowsPerTask = std::max(1, std::min(16, n / 64));
+    int tasks = (n + rowsPerTask - 1) / rowsPerTask;
+    pool->run(tasks, [this, re, im, inverse, rowsPerTask](int task) {
+        int end = std::min(n, (task + 1) * rowsPerTask);
+        for (int row = task * rowsPerTask; row < end; row++) {
+            size_t offset = (size_t)row * stride;
+            if (inverse) {
+                fft.inverse(re + offset, im + offset);
+            } else {
+                fft.forward(re + offset, im + offset);
+            }
+        }
+    });
+}
+
+void FFT2D::transformColumns(float* re, float* im, bool inverse) {
+    int tasks = (n + STRIP - 1) / STRIP;
+    pool->run(tasks, [this, re, im, inverse](int task) {
+        int first = task * STRIP;
+        int width = std::min(STRIP, n - first);
+        if (inverse) {
+            fft.inverseColumns(re + first, im + first, stride, width);
+        } else {
+            fft.forwardColumns(re + first, im + first, stride, width);
+        }
+    });
+}
+
+void FFT2D::forward(float* re, float* im) {
+    transformRows(re, im, false);
+    transformColumns(re, im, false);
+}
+
+void FFT2D::inverse(float* re, float* im) {
+    transformRows(re, im, true);
+    transformColumns(re, im, true);
+}
@@ -0,0 +1,125 @@
+#include "FrameProfiler.h"
+#include <fstream>
+#include <iostream>
+
+const float FrameProfiler::MISSING = -1.0f;
+
+FrameProfiler::FrameProfiler() : frame(0) {
+}
+
+FrameProfiler::~FrameProfiler() {
+    for (size_t i = 0; i < sections.size(); i++) {
+        if (sections[i].gpu) {
+            glDeleteQueries(LATENCY, sections[i].queries);
+        }
+    }
+}
+
+int FrameProfiler::addSection(const std::string& name, bool gpu) {
+    Section section;
+    section.name = name;
+    section.gpu = gpu;
+    for (int i = 0; i < LATENCY; i++) {
+        section.queries[i] = 0;
+        section.issued[i] = false;
+    }
+    for (int i = 0; i < HISTORY; i++) {
+        section.history[i] = MISSING;
+    }
+    if (gpu) {
+        glGenQueries(LATENCY, section.queries);
+    }
+    sections.push_back(section);
+    return (int)sections.size() - 1;
+}
+
+void FrameProfiler::beginCpu(int section) {
+    sections[section].start = std::chrono::steady_clock::now();
+}
+
+void FrameProfiler::endCpu(int section) {
+    std::chrono::duration<float, std::milli> elapsed = std::chrono::steady_clock::now() - sections[section].start;
+    addCpuTime(section, elapsed.count());
+}
+
+void FrameProfiler::addCpuTime(int section, float milliseconds) {
+    float& sample = sections[section].history[frame % HISTORY];
+    sample = sample == MISSING ? milliseconds : sample + milliseconds;
+}
+
+void FrameProfiler::beginGpu(int section) {
+    Section& s = sections[section];
+    int slot = frame % LATENCY;
+    glBeginQuery(GL_TIME_ELAPSED, s.queries[slot]);
+    s.issued[slot] = true;
+}
+
+void FrameProfiler::endGpu(int section) {
+    (void)section;
+    glEndQuery(GL_TIME_ELAPSED);
+}
+
+void FrameProfiler::endFrame() {
+    frame++;
+    for (size_t i = 0; i < sections.size(); i++) {
+        sections[i].history[frame % HISTORY] = MISSING;
+    }
+    collectGpuResults();
+}
+
+// The queries about to be reused this frame were issued LATENCY frames ago.
+// A result that is still not available is dropped rather than waited for.
+void FrameProfiler::collectGpuResults() {
+    int slot = frame % LATENCY;
+    for (size_t i = 0; i < sections.size(); i++) {
+        Section& s = sections[i];
+        if (!s.gpu || !s.issued[slot]) {
+            continue;
+        }
+        s.issued[slot] = false;
+        GLint available = 0;
+        glGetQueryObjectiv(s.queries[slot], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(s.queries[slot], GL_QUERY_RESULT, &elapsed);
+            s.history[(frame - LATENCY) % HISTORY] = elapsed / 1e6f;
+        }
+    }
+}
+
+int FrameProfiler::getFrameCount() const {
+    return frame < HISTORY - 1 ? (int)frame : HISTORY - 1;
+}
+
+float FrameProfiler::getTime(int section, int age) const {
+    if (age < 1 || age > getFrameCount()) {
+        return MISSING;
+    }
+    return sections[section].history[(frame - age) % HISTORY];
+}
+
+bool FrameProfiler::writeCsv(const std::string& path) const {
+    std::ofstream file(path.c_str());
+    file << "frame";
+    for (size_t i = 0; i < sections.size(); i++) {
+        file << "," << sections[i].name << (sections[i].gpu ? " (GPU ms)" : " (CPU ms)");
+    }
+    file << "\n";
+    for (int age = getFrameCount(); age >= 1; age--) {
+        file << frame - age;
+        for (size_t i = 0; i < sections.size(); i++) {
+            file << ",";
+            float time = getTime((int)i, age);
+            if (time != MISSING) {
+                file << time;
+            }
+        }
+        file << "\n";
+    }
+    if (!file) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return false;
+    }
+    std::cout << "Frame times written to " << path << std::endl;
+    return true;
+}
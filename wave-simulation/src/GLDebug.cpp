@@ -0,0 +1,97 @@
+#include "GLDebug.h"
+#include <cstring>
+#include <iostream>
+
+namespace GLDebug {
+
+static bool callbackInstalled = false;
+static const char* currentSite = nullptr;
+
+static const char* typeName(GLenum type) {
+    switch (type) {
+        case GL_DEBUG_TYPE_ERROR: return "error";
+        case GL_DEBUG_TYPE_DEPRECATED_BEHAVIOR: return "deprecated behavior";
+        case GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR: return "undefined behavior";
+        case GL_DEBUG_TYPE_PORTABILITY: return "portability";
+        case GL_DEBUG_TYPE_PERFORMANCE: return "performance";
+        default: return "message";
+    }
+}
+
+static void APIENTRY callback(GLenum source, GLenum type, GLuint id, GLenum severity,
+                              GLsizei length, const GLchar* message, const void* userParam) {
+    (void)source;
+    (void)severity;
+    (void)length;
+    (void)userParam;
+    std::cerr << "OpenGL " << typeName(type) << " " << id
+              << " [" << (currentSite ? currentSite : "unscoped") << "]: " << message << std::endl;
+}
+
+static bool supportsDebugOutput() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 3)) {
+        return true;
+    }
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (name && strcmp(name, "GL_KHR_debug") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+void initialize() {
+#if GL_DEBUG_LEVEL > GL_DEBUG_OFF
+    if (callbackInstalled || !supportsDebugOutput()) {
+        return;
+    }
+    glEnable(GL_DEBUG_OUTPUT);
+    glDebugMessageCallback(callback, nullptr);
+#if GL_DEBUG_LEVEL >= GL_DEBUG_VERBOSE
+    glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_NOTIFICATION, 0, nullptr, GL_FALSE);
+#else
+    // Errors only; they may arrive asynchronously, so the scope is a hint
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, nullptr, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, nullptr, GL_TRUE);
+#endif
+    callbackInstalled = true;
+    std::cout << "OpenGL debug output enabled ("
+              << (GL_DEBUG_LEVEL >= GL_DEBUG_VERBOSE ? "verbose" : "errors") << ")" << std::endl;
+#endif
+}
+
+void check(const char* site) {
+    if (callbackInstalled) {
+        return;
+    }
+    for (GLenum error = glGetError(); error != GL_NO_ERROR; error = glGetError()) {
+        std::cerr << "OpenGL error 0x" << std::hex << error << std::dec << " at " << site << std::endl;
+    }
+}
+
+Scope::Scope(const char* site) : previous(currentSite) {
+    currentSite = site;
+#if GL_DEBUG_LEVEL >= GL_DEBUG_VERBOSE
+    if (callbackInstalled) {
+        glPushDebugGroup(GL_DEBUG_SOURCE_APPLICATION, 0, -1, site);
+    }
+#endif
+}
+
+Scope::~Scope() {
+#if GL_DEBUG_LEVEL >= GL_DEBUG_VERBOSE
+    if (callbackInstalled) {
+        glPopDebugGroup();
+    }
+#endif
+    currentSite = previous;
+}
+
+}
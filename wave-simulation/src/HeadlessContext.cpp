@@ -0,0 +1,146 @@
+#include "HeadlessContext.h"
+#include "GLDebug.h"
+#include <EGL/eglext.h>
+#include <cstdio>
+#include <iostream>
+
+HeadlessContext::HeadlessContext(int width, int height)
+    : display(EGL_NO_DISPLAY), surface(EGL_NO_SURFACE), context(EGL_NO_CONTEXT),
+      framebuffer(0), colorBuffer(0), depthBuffer(0), width(width), height(height) {
+}
+
+HeadlessContext::~HeadlessContext() {
+    if (context != EGL_NO_CONTEXT) {
+        if (framebuffer) glDeleteFramebuffers(1, &framebuffer);
+        if (colorBuffer) glDeleteRenderbuffers(1, &colorBuffer);
+        if (depthBuffer) glDeleteRenderbuffers(1, &depthBuffer);
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(display, context);
+    }
+    if (surface != EGL_NO_SURFACE) {
+        eglDestroySurface(display, surface);
+    }
+    if (display != EGL_NO_DISPLAY) {
+        eglTerminate(display);
+    }
+}
+
+bool HeadlessContext::initialize() {
+    return createContext() && createFramebuffer();
+}
+
+bool HeadlessContext::createContext() {
+    // Prefer Mesa's surfaceless platform: it needs no X server or GPU device
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getPlatformDisplay =
+        (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    bool surfaceless = false;
+    if (getPlatformDisplay) {
+        display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+        surfaceless = display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr);
+    }
+    if (!surfaceless) {
+        display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, nullptr, nullptr)) {
+            std::cerr << "Failed to initialize an EGL display" << std::endl;
+            display = EGL_NO_DISPLAY;
+            return false;
+        }
+    }
+    if (!eglBindAPI(EGL_OPENGL_API)) {
+        std::cerr << "EGL display does not support desktop OpenGL" << std::endl;
+        return false;
+    }
+
+    const EGLint configAttributes[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    eglChooseConfig(display, configAttributes, &config, 1, &configCount);
+    if (configCount == 0 && !surfaceless) {
+        std::cerr << "No EGL pbuffer config with OpenGL support" << std::endl;
+        return false;
+    }
+
+    const EGLint contextAttributes[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 3,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+#if GL_DEBUG_LEVEL >= GL_DEBUG_VERBOSE
+        EGL_CONTEXT_OPENGL_DEBUG, EGL_TRUE,
+#endif
+        EGL_NONE
+    };
+    context = eglCreateContext(display, configCount ? config : nullptr, EGL_NO_CONTEXT, contextAttributes);
+    if (context == EGL_NO_CONTEXT) {
+        std::cerr << "Failed to create an OpenGL 3.3 core context (EGL error 0x"
+                  << std::hex << eglGetError() << std::dec << ")" << std::endl;
+        return false;
+    }
+
+    // Without the surfaceless platform a context needs some surface to be
+    // current; the frames themselves go to the framebuffer object
+    if (!surfaceless) {
+        const EGLint pbufferAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+        surface = eglCreatePbufferSurface(display, config, pbufferAttributes);
+        if (surface == EGL_NO_SURFACE) {
+            std::cerr << "Failed to create an EGL pbuffer" << std::endl;
+            return false;
+        }
+    }
+    if (!eglMakeCurrent(display, surface, surface, context)) {
+        std::cerr << "Failed to make the EGL context current" << std::endl;
+        return false;
+    }
+
+    std::cout << "Headless context: " << glGetString(GL_RENDERER) << ", OpenGL "
+              << glGetString(GL_VERSION) << (surfaceless ? " (surfaceless)" : " (pbuffer)") << std::endl;
+    return true;
+}
+
+bool HeadlessContext::createFramebuffer() {
+    glGenRenderbuffers(1, &colorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, colorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+
+    glGenRenderbuffers(1, &depthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, depthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, colorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthBuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        std::cerr << "Headless framebuffer " << width << "x" << height << " is incomplete" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::writePPM(const std::string& path) const {
+    std::vector<unsigned char> pixels((size_t)width * height * 3);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, framebuffer);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, &pixels[0]);
+
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file) {
+        std::cerr << "Cannot write " << path << std::endl;
+        return false;
+    }
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    // OpenGL rows run bottom-up, PPM rows top-down
+    size_t rowBytes = (size_t)width * 3;
+    for (int y = height - 1; y >= 0; y--) {
+        fwrite(&pixels[y * rowBytes], 1, rowBytes, file);
+    }
+    bool ok = fclose(file) == 0;
+    if (!ok) {
+        std::cerr << "Cannot write " << path << std::endl;
+    }
+    return ok;
+}
@@ -0,0 +1,224 @@
+#include "HeightField.h"
+#include "ParameterBlocks.h"
+#include "WaveFunction.h"
+#include <iostream>
+#include <utility>
+
+HeightField::HeightField(int analyticSize)
+    : analyticShaders(nullptr), gradientShaders(nullptr),
+      pendingAnalyticShaders(nullptr), pendingGradientShaders(nullptr), emptyVAO(0),
+      fieldTexture(0), fieldFBO(0), heightSize(0), fieldSize(0), analyticSize(analyticSize) {
+    for (int i = 0; i < 2; i++) {
+        heightTextures[i] = 0;
+        heightPublications[i] = 0;
+        heightLoaded[i] = false;
+    }
+}
+
+HeightField::~HeightField() {
+    delete analyticShaders;
+    delete gradientShaders;
+    delete pendingAnalyticShaders;
+    delete pendingGradientShaders;
+
+    if (emptyVAO) glDeleteVertexArrays(1, &emptyVAO);
+    if (fieldFBO) glDeleteFramebuffers(1, &fieldFBO);
+    if (heightTextures[0]) glDeleteTextures(2, heightTextures);
+    if (fieldTexture) glDeleteTextures(1, &fieldTexture);
+}
+
+ShaderVariants* HeightField::createAnalyticShaders() {
+    return new ShaderVariants("shaders/fullscreen.vert", "shaders/heightfield.frag",
+                              std::vector<std::string>(1, "RIPPLES"), WaveFunction::glsl());
+}
+
+ShaderVariants* HeightField::createGradientShaders() {
+    return new ShaderVariants("shaders/fullscreen.vert", "shaders/gradient.frag",
+                              std::vector<std::string>());
+}
+
+void HeightField::prepareShaders() {
+    for (int i = 0; i < analyticShaders->size(); i++) {
+        ShaderManager* shader = (*analyticShaders)[i];
+        bindParameterBlocks(*shader);
+        shader->use();
+        shader->setVec2("fieldSize", (float)analyticSize, (float)analyticSize);
+    }
+    ShaderManager* gradient = gradientShaders->get(0);
+    bindParameterBlocks(*gradient);
+    gradient->use();
+    gradient->setInt("previousHeights", 0);
+    gradient->setInt("heights", 1);
+}
+
+bool HeightField::initialize() {
+    analyticShaders = createAnalyticShaders();
+    if (!analyticShaders->compile()) {
+        std::cerr << "Failed to load height field shaders" << std::endl;
+        return false;
+    }
+    gradientShaders = createGradientShaders();
+    if (!gradientShaders->compile()) {
+        std::cerr << "Failed to load gradient shaders" << std::endl;
+        return false;
+    }
+    prepareShaders();
+
+    glGenVertexArrays(1, &emptyVAO);
+
+    GLuint textures[3];
+    glGenTextures(3, textures);
+    heightTextures[0] = textures[0];
+    heightTextures[1] = textures[1];
+    fieldTexture = textures[2];
+    for (int i = 0; i < 3; i++) {
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    // The attachment stays valid across resizes, which only respecify storage
+    GLint previous;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+    glGenFramebuffers(1, &fieldFBO);
+    glBindFramebuffer(GL_FRAMEBUFFER, fieldFBO);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, fieldTexture, 0);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+
+    std::cout << "Height field: " << analyticSize << "x" << analyticSize << " texels" << std::endl;
+    return true;
+}
+
+void HeightField::beginReload() {
+    if (isReloading()) {
+        return;
+    }
+    pendingAnalyticShaders = createAnalyticShaders();
+    pendingGradientShaders = createGradientShaders();
+    pendingAnalyticShaders->beginCompile();
+    pendingGradientShaders->beginCompile();
+}
+
+bool HeightField::pollReload() {
+    return isReloading() && pendingAnalyticShaders->poll() && pendingGradientShaders->poll();
+}
+
+bool HeightField::finishReload() {
+    bool ok = pendingAnalyticShaders->finishCompile();
+    return pendingGradientShaders->finishCompile() && ok;
+}
+
+void HeightField::endReload(bool commit) {
+    if (commit) {
+        std::swap(analyticShaders, pendingAnalyticShaders);
+        std::swap(gradientShaders, pendingGradientShaders);
+        prepareShaders();
+    }
+    pendingAnalyticShaders->evictCache(analyticShaders);
+    pendingGradientShaders->evictCache(gradientShaders);
+    delete pendingAnalyticShaders;
+    delete pendingGradientShaders;
+    pendingAnalyticShaders = nullptr;
+    pendingGradientShaders = nullptr;
+}
+
+void HeightField::resizeField(int size) {
+    if (size == fieldSize) {
+        return;
+    }
+    glBindTexture(GL_TEXTURE_2D, fieldTexture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, size, size, 0, GL_RGBA, GL_FLOAT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    fieldSize = size;
+}
+
+void HeightField::runPass(ShaderManager* shader) {
+    GLint previous;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previous);
+    GLboolean depthTest = glIsEnabled(GL_DEPTH_TEST);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fieldFBO);
+    glViewport(0, 0, fieldSize, fieldSize);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+
+    shader->use();
+    glBindVertexArray(emptyVAO);
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBindVertexArray(0);
+
+    if (depthTest) glEnable(GL_DEPTH_TEST);
+    if (blend) glEnable(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, previous);
+}
+
+void HeightField::renderAnalytic(bool ripples) {
+    resizeField(analyticSize);
+    runPass(analyticShaders->get(ripples ? 1 : 0));
+}
+
+// Returns the height texture holding publication, copying it from the
+// stream into the one other than keep if neither does
+int HeightField::loadHeights(HeightStream& stream, unsigned publication, int keep) {
+    for (int i = 0; i < 2; i++) {
+        if (heightLoaded[i] && heightPublications[i] == publication) {
+            return i;
+        }
+    }
+    int slot = keep == 0 ? 1 : 0;
+    glBindTexture(GL_TEXTURE_2D, heightTextures[slot]);
+    stream.copy(publication, heightSize);
+    heightPublications[slot] = publication;
+    heightLoaded[slot] = true;
+    return slot;
+}
+
+// The solver grid has fixed edges and is clamped; the ocean tile is periodic
+// and repeats. The textures are reallocated when the engine size changes.
+// While the steps come one per frame, the texture holding the last frame's
+// current step serves as this frame's previous one and only the new step is
+// copied.
+void HeightField::upload(HeightStream& stream, unsigned previous, unsigned current, float blend, int size,
+                         GLint wrap) {
+    glActiveTexture(GL_TEXTURE0);
+    if (size != heightSize) {
+        for (int i = 0; i < 2; i++) {
+            glBindTexture(GL_TEXTURE_2D, heightTextures[i]);
+            glTexImage2D(GL_TEXTURE_2D, 0, GL_R32F, size, size, 0, GL_RED, GL_FLOAT, nullptr);
+            heightLoaded[i] = false;
+        }
+        heightSize = size;
+    }
+    // Before binding the sources: a resize rebinds the active unit
+    resizeField(size);
+    int previousSlot = loadHeights(stream, previous, -1);
+    int currentSlot = loadHeights(stream, current, previousSlot);
+
+    GLuint textures[2] = { heightTextures[previousSlot], heightTextures[currentSlot] };
+    for (int i = 1; i >= 0; i--) {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, textures[i]);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, wrap);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, wrap);
+    }
+
+    ShaderManager* gradient = gradientShaders->get(0);
+    gradient->use();
+    gradient->setFloat("blend", blend);
+    runPass(gradient);
+
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void HeightField::generateMipmaps() {
+    glBindTexture(GL_TEXTURE_2D, fieldTexture);
+    glGenerateMipmap(GL_TEXTURE_2D);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
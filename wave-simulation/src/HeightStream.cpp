@@ -0,0 +1,122 @@
+#include "HeightStream.h"
+#include <cstring>
+#include <iostream>
+
+static const GLuint64 MAKE_ROOM_TIMEOUT = 1000000000;   // ns; then the writer skips
+
+static bool supportsBufferStorage() {
+    GLint major = 0, minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 4)) {
+        return true;
+    }
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (name && strcmp(name, "GL_ARB_buffer_storage") == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+HeightStream::HeightStream()
+    : buffer(0), memory(nullptr), persistent(false), regionFloats(0), retired(0), copied(0), fenced(0) {
+}
+
+HeightStream::~HeightStream() {
+    for (size_t i = 0; i < fences.size(); i++) {
+        glDeleteSync(fences[i].sync);
+    }
+    if (persistent) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &buffer);
+    } else {
+        delete[] memory;
+    }
+}
+
+void HeightStream::initialize(size_t floats) {
+    regionFloats = floats;
+    GLsizeiptr bytes = (GLsizeiptr)(REGIONS * regionFloats * sizeof(float));
+
+    // Coherent, so the writer's stores need no explicit flush before a copy;
+    // readable, so WaveField can take its own copy of each step
+    if (supportsBufferStorage()) {
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bytes, nullptr, flags);
+        memory = (float*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bytes, flags);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        persistent = memory != nullptr;
+        if (!persistent) {
+            std::cerr << "Cannot map the height stream; uploading from memory instead" << std::endl;
+            glDeleteBuffers(1, &buffer);
+            buffer = 0;
+        }
+    }
+    if (!persistent) {
+        memory = new float[REGIONS * regionFloats]();
+    }
+
+    std::cout << "Height stream: " << REGIONS << " regions of " << regionFloats * sizeof(float) / 1024 << " KB, "
+              << (persistent ? "persistently mapped" : "copied by glTexSubImage2D") << std::endl;
+}
+
+float* HeightStream::region(unsigned publication) {
+    if (publication - retired.load(std::memory_order_acquire) >= REGIONS) {
+        return nullptr;
+    }
+    return memory + (size_t)(publication % REGIONS) * regionFloats;
+}
+
+void HeightStream::copy(unsigned publication, int size) {
+    size_t offset = (size_t)(publication % REGIONS) * regionFloats;
+    if (persistent) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, buffer);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_FLOAT,
+                        (const void*)(offset * sizeof(float)));
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    } else {
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, size, size, GL_RED, GL_FLOAT, memory + offset);
+    }
+    // Copies go forward, apart from a frame's previous step coming just
+    // before its current one
+    if ((int)(publication + 1 - copied) > 0) {
+        copied = publication + 1;
+    }
+}
+
+void HeightStream::endFrame(bool makeRoom) {
+    if (!persistent) {
+        // glTexSubImage2D has read the memory already
+        retired.store(copied, std::memory_order_release);
+        return;
+    }
+    if (copied != fenced) {
+        Fence fence = { glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), copied };
+        fences.push_back(fence);
+        fenced = copied;
+    }
+    retire(makeRoom);
+}
+
+// Fences signal in order, so the oldest decides
+void HeightStream::retire(bool makeRoom) {
+    while (!fences.empty()) {
+        bool room = copied - retired.load(std::memory_order_relaxed) < REGIONS;
+        GLuint64 timeout = makeRoom && !room ? MAKE_ROOM_TIMEOUT : 0;
+        GLenum status = glClientWaitSync(fences.front().sync, timeout ? GL_SYNC_FLUSH_COMMANDS_BIT : 0, timeout);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED) {
+            return;
+        }
+        retired.store(fences.front().retired, std::memory_order_release);
+        glDeleteSync(fences.front().sync);
+        fences.pop_front();
+    }
+}
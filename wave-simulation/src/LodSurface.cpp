@@ -0,0 +1,164 @@
+#include "LodSurface.h"
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+// Level l covers camera distances up to RANGE_SCALE of its patch sizes, and
+// its patches morph over the last MORPH_SHARE of that. Where a level-l patch
+// meets a coarser one, the coarse side must not have started morphing yet,
+// which holds while RANGE_SCALE * (1 - 2 * MORPH_SHARE) > 2 * sqrt(2).
+static const float RANGE_SCALE = 5.0f;
+static const float MORPH_SHARE = 0.2f;
+
+LodSurface::LodSurface()
+    : VAO(0), indexBuffer(0), instanceBuffer(0), sampler(0), indexCount(0), rootSize(0.0f) {
+}
+
+LodSurface::~LodSurface() {
+    if (VAO) glDeleteVertexArrays(1, &VAO);
+    if (indexBuffer) glDeleteBuffers(1, &indexBuffer);
+    if (instanceBuffer) glDeleteBuffers(1, &instanceBuffer);
+    if (sampler) glDeleteSamplers(1, &sampler);
+}
+
+bool LodSurface::initialize(float size) {
+    rootSize = size;
+    for (int level = 0; level < LEVELS; level++) {
+        ranges[level] = RANGE_SCALE * rootSize / (float)(1 << (LEVELS - 1 - level));
+    }
+
+    // One patch: (PATCH_RESOLUTION + 1)^2 vertices, numbered row by row,
+    // with the same triangle orientation as the [-1, 1] grid
+    const int side = PATCH_RESOLUTION + 1;
+    std::vector<GLushort> indices;
+    indices.reserve(PATCH_RESOLUTION * PATCH_RESOLUTION * 6);
+    for (int z = 0; z < PATCH_RESOLUTION; z++) {
+        for (int x = 0; x < PATCH_RESOLUTION; x++) {
+            GLushort topLeft = (GLushort)(z * side + x);
+            GLushort topRight = topLeft + 1;
+            GLushort bottomLeft = (GLushort)(topLeft + side);
+            GLushort bottomRight = bottomLeft + 1;
+            indices.push_back(topLeft);
+            indices.push_back(bottomLeft);
+            indices.push_back(topRight);
+            indices.push_back(topRight);
+            indices.push_back(bottomLeft);
+            indices.push_back(bottomRight);
+        }
+    }
+    indexCount = (int)indices.size();
+
+    glGenVertexArrays(1, &VAO);
+    glGenBuffers(1, &indexBuffer);
+    glGenBuffers(1, &instanceBuffer);
+    glBindVertexArray(VAO);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(GLushort), &indices[0], GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+    glBufferData(GL_ARRAY_BUFFER, MAX_PATCHES * sizeof(Instance), nullptr, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, x));
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Instance), (void*)offsetof(Instance, morphStart));
+    glVertexAttribDivisor(0, 1);
+    glVertexAttribDivisor(1, 1);
+    glEnableVertexAttribArray(0);
+    glEnableVertexAttribArray(1);
+    glBindVertexArray(0);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+    // Far patches sample the field sparsely; mipmaps keep them from aliasing
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, GL_REPEAT);
+
+    std::cout << "LOD surface: " << rootSize << " units, " << LEVELS << " levels, "
+              << PATCH_RESOLUTION << "x" << PATCH_RESOLUTION << " quads per patch" << std::endl;
+    return true;
+}
+
+// Gribb and Hartmann: each plane is the last row of the matrix plus or minus
+// one of the others
+void LodSurface::extractPlanes(const float* m) {
+    for (int i = 0; i < 3; i++) {
+        for (int j = 0; j < 4; j++) {
+            planes[i * 2][j] = m[j * 4 + 3] + m[j * 4 + i];
+            planes[i * 2 + 1][j] = m[j * 4 + 3] - m[j * 4 + i];
+        }
+    }
+}
+
+// The node's box spans its square and +-heightBound; it is outside when its
+// corner furthest along a plane normal is behind that plane
+bool LodSurface::isVisible(float x, float z, float size, float heightBound) const {
+    for (int i = 0; i < 6; i++) {
+        const float* p = planes[i];
+        float px = p[0] > 0.0f ? x + size : x;
+        float py = p[1] > 0.0f ? heightBound : -heightBound;
+        float pz = p[2] > 0.0f ? z + size : z;
+        if (p[0] * px + p[1] * py + p[2] * pz + p[3] < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Distance from the camera to the nearest point of the node at sea level,
+// as patch.glsl measures it
+bool LodSurface::withinRange(float x, float z, float size, const float* camera, float range) const {
+    float dx = std::max(std::max(x - camera[0], camera[0] - (x + size)), 0.0f);
+    float dz = std::max(std::max(z - camera[2], camera[2] - (z + size)), 0.0f);
+    return dx * dx + camera[1] * camera[1] + dz * dz < range * range;
+}
+
+void LodSurface::addPatch(float x, float z, float size, int level) {
+    if ((int)instances.size() >= MAX_PATCHES) {
+        return;
+    }
+    Instance instance = { x, z, size, ranges[level] * (1.0f - MORPH_SHARE), ranges[level] };
+    instances.push_back(instance);
+}
+
+// A node within the next finer level's range is split; its children are
+// selected at that level even if they fall outside the range, where they
+// are fully morphed and match this level's density
+void LodSurface::select(float x, float z, float size, int level, const float* camera, float heightBound) {
+    if (!isVisible(x, z, size, heightBound)) {
+        return;
+    }
+    if (level == 0 || !withinRange(x, z, size, camera, ranges[level - 1])) {
+        addPatch(x, z, size, level);
+        return;
+    }
+    float half = size * 0.5f;
+    select(x, z, half, level - 1, camera, heightBound);
+    select(x + half, z, half, level - 1, camera, heightBound);
+    select(x, z + half, half, level - 1, camera, heightBound);
+    select(x + half, z + half, half, level - 1, camera, heightBound);
+}
+
+void LodSurface::update(const float* viewProjection, const float* camera, float heightBound) {
+    extractPlanes(viewProjection);
+    instances.clear();
+    float origin = -0.5f * rootSize;
+    select(origin, origin, rootSize, LEVELS - 1, camera, heightBound);
+
+    if (!instances.empty()) {
+        glBindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+        glBufferSubData(GL_ARRAY_BUFFER, 0, instances.size() * sizeof(Instance), &instances[0]);
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
+}
+
+void LodSurface::draw() const {
+    if (instances.empty()) {
+        return;
+    }
+    glBindSampler(0, sampler);
+    glBindVertexArray(VAO);
+    glDrawElementsInstanced(GL_TRIANGLES, indexCount, GL_UNSIGNED_SHORT, 0, (GLsizei)instances.size());
+    glBindVertexArray(0);
+    glBindSampler(0, 0);
+}
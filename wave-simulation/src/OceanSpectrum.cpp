@@ -0,0 +1,121 @@
+#include "OceanSpectrum.h"
+#include <algorithm>
+#include <cmath>
+#include <random>
+
+#ifndef M_PI
+#define M_PI 3.14159265358979323846
+#endif
+
+const float OceanSpectrum::GRAVITY = 9.81f;
+const float OceanSpectrum::PATCH_LENGTH = 200.0f;
+const float OceanSpectrum::WIND_SPEED = 12.0f;
+const float OceanSpectrum::TARGET_RMS = 0.3f;
+
+OceanSpectrum::OceanSpectrum(int size, WorkerPool* pool, Spectrum spectrum)
+    : size(size), spectrum(spectrum), windX(0.8f), windZ(0.6f),
+      h0Re(size * size), h0Im(size * size), h0ConjRe(size * size), h0ConjIm(size * size),
+      omega(size * size), fft(size, pool), pool(pool),
+      re((size_t)size * fft.getStride()), im((size_t)size * fft.getStride()) {
+    buildSpectrum();
+}
+
+float OceanSpectrum::waveNumber(int index) const {
+    // Unshifted FFT ordering: 0, 1, ..., N/2 - 1, -N/2, ..., -1
+    int n = index < size / 2 ? index : index - size;
+    return 2.0f * (float)M_PI * n / PATCH_LENGTH;
+}
+
+// Directional energy density P(k) at wave vector (kx, kz)
+float OceanSpectrum::density(float kx, float kz) const {
+    float k = std::sqrt(kx * kx + kz * kz);
+    if (k < 1e-6f) {
+        return 0.0f;
+    }
+    float cosTheta = (kx * windX + kz * windZ) / k;
+
+    if (spectrum == PHILLIPS) {
+        float largest = WIND_SPEED * WIND_SPEED / GRAVITY;
+        float smallest = largest / 1000.0f;
+        float k2 = k * k;
+        return std::exp(-1.0f / (k2 * largest * largest)) / (k2 * k2)
+               * cosTheta * cosTheta * std::exp(-k2 * smallest * smallest);
+    }
+
+    // JONSWAP frequency spectrum for a 100 km fetch, mapped to wave numbers
+    // through w = sqrt(g k) and spread with cos^2 around the wind.
+    if (cosTheta <= 0.0f) {
+        return 0.0f;
+    }
+    const float fetch = 100000.0f;
+    const float gamma = 3.3f;
+    float w = std::sqrt(GRAVITY * k);
+    float alpha = 0.076f * std::pow(WIND_SPEED * WIND_SPEED / (fetch * GRAVITY), 0.22f);
+    float peak = 22.0f * std::pow(GRAVITY * GRAVITY / (WIND_SPEED * fetch), 1.0f / 3.0f);
+    float sigma = w <= peak ? 0.07f : 0.09f;
+    float r = std::exp(-(w - peak) * (w - peak) / (2.0f * sigma * sigma * peak * peak));
+    float s = alpha * GRAVITY * GRAVITY / std::pow(w, 5.0f)
+              * std::exp(-1.25f * std::pow(peak / w, 4.0f)) * std::pow(gamma, r);
+    float dwdk = GRAVITY / (2.0f * w);
+    return s * dwdk / k * (2.0f / (float)M_PI) * cosTheta * cosTheta;
+}
+
+void OceanSpectrum::buildSpectrum() {
+    // Fixed seed so every run (and every benchmark) sees the same sea
+    std::mt19937 rng(1337);
+    std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+    for (int i = 0; i < size; i++) {
+        float kz = waveNumber(i);
+        for (int j = 0; j < size; j++) {
+            float kx = waveNumber(j);
+            float amplitude = std::sqrt(density(kx, kz) * 0.5f);
+            int idx = i * size + j;
+            h0Re[idx] = gauss(rng) * amplitude;
+            h0Im[idx] = gauss(rng) * amplitude;
+            omega[idx] = std::sqrt(GRAVITY * std::sqrt(kx * kx + kz * kz));
+        }
+    }
+
+    double variance = 0.0;
+    for (int i = 0; i < size; i++) {
+        for (int j = 0; j < size; j++) {
+            int idx = i * size + j;
+            int mirrored = ((size - i) % size) * size + (size - j) % size;
+            h0ConjRe[idx] = h0Re[mirrored];
+            h0ConjIm[idx] = -h0Im[mirrored];
+            variance += 2.0 * ((double)h0Re[idx] * h0Re[idx] + (double)h0Im[idx] * h0Im[idx]);
+        }
+    }
+
+    float scale = variance > 0.0 ? TARGET_RMS / (float)std::sqrt(variance) : 0.0f;
+    for (size_t idx = 0; idx < h0Re.size(); idx++) {
+        h0Re[idx] *= scale;
+        h0Im[idx] *= scale;
+        h0ConjRe[idx] *= scale;
+        h0ConjIm[idx] *= scale;
+    }
+}
+
+void OceanSpectrum::update(float time) {
+    // h(k, t) = h0(k) e^{iwt} + conj(h0(-k)) e^{-iwt}, one task per row band
+    const int rowsPerTask = 16;
+    int tasks = (size + rowsPerTask - 1) / rowsPerTask;
+    int stride = fft.getStride();
+    pool->run(tasks, [this, time, rowsPerTask, stride](int task) {
+        int end = std::min(size, (task + 1) * rowsPerTask);
+        for (int i = task * rowsPerTask; i < end; i++) {
+            float* outRe = &re[(size_t)i * stride];
+            float* outIm = &im[(size_t)i * stride];
+            for (int j = 0; j < size; j++) {
+                int idx = i * size + j;
+                float c = std::cos(omega[idx] * time);
+                float s = std::sin(omega[idx] * time);
+                outRe[j] = (h0Re[idx] + h0ConjRe[idx]) * c + (h0ConjIm[idx] - h0Im[idx]) * s;
+                outIm[j] = (h0Im[idx] + h0ConjIm[idx]) * c + (h0Re[idx] - h0ConjRe[idx]) * s;
+            }
+        }
+    });
+
+    fft.inverse(&re[0], &im[0]);
+}
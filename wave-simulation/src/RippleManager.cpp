@@ -0,0 +1,75 @@
+#include "RippleManager.h"
+#include <cstddef>
+#include <cstring>
+
+const float RippleManager::LIFETIME = 4.0f;
+
+RippleManager::RippleManager() : head(0), count(0), dirty(true), buffer(0) {
+}
+
+RippleManager::~RippleManager() {
+    if (buffer) glDeleteBuffers(1, &buffer);
+}
+
+void RippleManager::initialize() {
+    glGenBuffers(1, &buffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(Block), nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    glBindBufferBase(GL_UNIFORM_BUFFER, BINDING, buffer);
+    dirty = true;
+}
+
+void RippleManager::emit(float x, float z, float time, float amplitude) {
+    // A full ring drops its oldest ripple
+    if (count == CAPACITY) {
+        head = (head + 1) % CAPACITY;
+        count--;
+    }
+    Ripple& r = ring[(head + count) % CAPACITY];
+    r.x = x;
+    r.z = z;
+    r.startTime = time;
+    r.amplitude = amplitude;
+    count++;
+    dirty = true;
+}
+
+void RippleManager::update(float time) {
+    // Ripples are emitted in time order, so expired ones are at the front
+    while (count > 0 && time - ring[head].startTime > LIFETIME) {
+        head = (head + 1) % CAPACITY;
+        count--;
+        dirty = true;
+    }
+}
+
+void RippleManager::clear() {
+    head = 0;
+    count = 0;
+    dirty = true;
+}
+
+void RippleManager::upload() {
+    if (!dirty || !buffer) {
+        return;
+    }
+
+    Block block;
+    std::memset(&block, 0, sizeof(block));
+    for (int i = 0; i < count; i++) {
+        const Ripple& r = (*this)[i];
+        block.ripples[i][0] = r.x;
+        block.ripples[i][1] = r.z;
+        block.ripples[i][2] = r.startTime;
+        block.ripples[i][3] = r.amplitude;
+    }
+    block.count[0] = count;
+
+    // Only the live prefix and the count need to reach the GPU
+    glBindBuffer(GL_UNIFORM_BUFFER, buffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, count * sizeof(block.ripples[0]), block.ripples);
+    glBufferSubData(GL_UNIFORM_BUFFER, offsetof(Block, count), sizeof(block.count), block.count);
+    glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    dirty = false;
+}
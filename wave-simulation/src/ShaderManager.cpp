@@ -1,9 +1,34 @@
 #include "ShaderManager.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <sys/stat.h>
 
-ShaderManager::ShaderManager() : programID(0), vertexShaderID(0), fragmentShaderID(0) {
+static const char PROGRAM_BINARY_MAGIC[4] = { 'W', 'S', 'P', 'B' };
+static const size_t MAX_INCLUDES = 32;
+
+std::string ShaderManager::cacheDirectory = "shader_cache";
+bool ShaderManager::parallelCompile = false;
+
+// 64-bit FNV-1a
+static unsigned long long hashString(const std::string& text, unsigned long long hash) {
+    for (size_t i = 0; i < text.size(); i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static std::string glString(GLenum name) {
+    const GLubyte* value = glGetString(name);
+    return value ? (const char*)value : "";
+}
+
+ShaderManager::ShaderManager()
+    : programID(0), vertexShaderID(0), fragmentShaderID(0), tessControlShaderID(0), tessEvaluationShaderID(0) {
 }
 
 ShaderManager::~ShaderManager() {
@@ -24,6 +49,74 @@ std::string ShaderManager::readShaderFile(const std::string& filepath) {
     return buffer.str();
 }
 
+std::string ShaderManager::injectPrelude(const std::string& source, const std::string& prelude) {
+    if (prelude.empty()) {
+        return source;
+    }
+    
+    // #version must stay first; #line keeps error messages pointing at the file
+    size_t versionEnd = source.find('\n');
+    if (source.compare(0, 8, "#version") != 0 || versionEnd == std::string::npos) {
+        return prelude + "#line 1\n" + source;
+    }
+    return source.substr(0, versionEnd + 1) + prelude + "#line 2\n" + source.substr(versionEnd + 1);
+}
+
+// Expands #include "file" lines, resolved relative to the including file.
+// Each file is included at most once per program. #line directives keep
+// compiler messages pointing at the right line; source string 0 is the top
+// file and n the nth included file.
+std::string ShaderManager::preprocess(const std::string& filepath, int fileNumber,
+                                      std::vector<std::string>& included) {
+    std::string source = readShaderFile(filepath);
+    if (source.empty()) {
+        return "";
+    }
+    
+    size_t slash = filepath.rfind('/');
+    std::string directory = slash == std::string::npos ? "" : filepath.substr(0, slash + 1);
+    
+    std::istringstream lines(source);
+    std::ostringstream out;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(lines, line)) {
+        lineNumber++;
+        size_t start = line.find_first_not_of(" \t");
+        if (start == std::string::npos || line.compare(start, 8, "#include") != 0) {
+            out << line << "\n";
+            continue;
+        }
+        
+        size_t open = line.find('"', start);
+        size_t close = open == std::string::npos ? open : line.find('"', open + 1);
+        if (close == std::string::npos) {
+            std::cerr << filepath << ":" << lineNumber << ": malformed #include" << std::endl;
+            return "";
+        }
+        std::string includePath = directory + line.substr(open + 1, close - open - 1);
+        if (std::find(included.begin(), included.end(), includePath) != included.end()) {
+            out << "\n";
+            continue;
+        }
+        if (included.size() >= MAX_INCLUDES) {
+            std::cerr << filepath << ":" << lineNumber << ": too many #includes" << std::endl;
+            return "";
+        }
+        
+        included.push_back(includePath);
+        int includeNumber = (int)included.size();
+        std::string body = preprocess(includePath, includeNumber, included);
+        if (body.empty()) {
+            return "";
+        }
+        out << "#line 1 " << includeNumber << "\n" << body
+            << "#line " << lineNumber + 1 << " " << fileNumber << "\n";
+    }
+    return out.str();
+}
+
+// Submits the compile without waiting for it; finishLoad() checks the result
 GLuint ShaderManager::compileShader(const std::string& source, GLenum shaderType) {
     GLuint shader = glCreateShader(shaderType);
     if (shader == 0) {
@@ -34,20 +127,94 @@ GLuint ShaderManager::compileShader(const std::string& source, GLenum shaderType
     const char* sourceCStr = source.c_str();
     glShaderSource(shader, 1, &sourceCStr, nullptr);
     glCompileShader(shader);
+    return shader;
+}
+
+// Binaries are only valid for the driver that produced them, so the driver
+// strings are part of the key along with the final sources (which include any
+// injected prelude and defines)
+std::string ShaderManager::cachePath(const std::vector<std::string>& sources) {
+    unsigned long long hash = 14695981039346656037ULL;
+    hash = hashString(glString(GL_VENDOR), hash);
+    hash = hashString(glString(GL_RENDERER), hash);
+    hash = hashString(glString(GL_VERSION), hash);
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (i > 0) {
+            hash = hashString(std::string(1, '\0'), hash);
+        }
+        hash = hashString(sources[i], hash);
+    }
     
-    // Check compilation status
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", hash);
+    return cacheDirectory + "/" + name;
+}
+
+bool ShaderManager::loadProgramBinary(const std::string& path) {
+    std::ifstream file(path.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        return false;
+    }
+    
+    char magic[4];
+    GLuint format = 0;
+    GLuint length = 0;
+    file.read(magic, sizeof(magic));
+    file.read((char*)&format, sizeof(format));
+    file.read((char*)&length, sizeof(length));
+    if (!file || std::string(magic, 4) != std::string(PROGRAM_BINARY_MAGIC, 4)) {
+        return false;
+    }
+    std::string binary(length, '\0');
+    file.read(&binary[0], length);
+    if (!file) {
+        return false;
+    }
+    
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, format, binary.data(), length);
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
     if (!success) {
-        checkCompileErrors(shader, shaderType == GL_VERTEX_SHADER ? "VERTEX" : "FRAGMENT");
-        glDeleteShader(shader);
-        return 0;
+        // Stale or foreign binary (e.g. after a driver update); recompile
+        glDeleteProgram(program);
+        std::remove(path.c_str());
+        return false;
     }
     
-    return shader;
+    programID = program;
+    return true;
 }
 
-void ShaderManager::checkCompileErrors(GLuint shader, const std::string& type) {
+// Written to a temporary file and renamed, so a concurrent start never reads
+// a partial binary
+void ShaderManager::saveProgramBinary(const std::string& path) {
+    GLint length = 0;
+    glGetProgramiv(programID, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) {
+        return;
+    }
+    std::string binary(length, '\0');
+    GLenum format = 0;
+    glGetProgramBinary(programID, length, nullptr, &format, &binary[0]);
+    
+    mkdir(cacheDirectory.c_str(), 0755);
+    std::string temporary = path + ".tmp";
+    std::ofstream file(temporary.c_str(), std::ios::binary);
+    if (!file.is_open()) {
+        return;
+    }
+    GLuint header[2] = { format, (GLuint)length };
+    file.write(PROGRAM_BINARY_MAGIC, sizeof(PROGRAM_BINARY_MAGIC));
+    file.write((const char*)header, sizeof(header));
+    file.write(binary.data(), length);
+    file.close();
+    if (!file || std::rename(temporary.c_str(), path.c_str()) != 0) {
+        std::remove(temporary.c_str());
+    }
+}
+
+bool ShaderManager::checkCompileErrors(GLuint shader, const std::string& type) {
     GLint success;
     GLchar infoLog[1024];
     glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
@@ -55,9 +222,10 @@ void ShaderManager::checkCompileErrors(GLuint shader, const std::string& type) {
         glGetShaderInfoLog(shader, 1024, nullptr, infoLog);
         std::cerr << "Shader compilation error (" << type << "): " << infoLog << std::endl;
     }
+    return success == GL_TRUE;
 }
 
-void ShaderManager::checkLinkErrors(GLuint program) {
+bool ShaderManager::checkLinkErrors(GLuint program) {
     GLint success;
     GLchar infoLog[1024];
     glGetProgramiv(program, GL_LINK_STATUS, &success);
@@ -65,106 +233,280 @@ void ShaderManager::checkLinkErrors(GLuint program) {
         glGetProgramInfoLog(program, 1024, nullptr, infoLog);
         std::cerr << "Shader linking error: " << infoLog << std::endl;
     }
+    return success == GL_TRUE;
+}
+
+bool ShaderManager::loadShaders(const std::string& vertexPath, const std::string& fragmentPath,
+                                const std::string& prelude, const std::vector<std::string>& defines) {
+    return beginLoad(vertexPath, fragmentPath, prelude, defines) && finishLoad();
+}
+
+bool ShaderManager::beginLoad(const std::string& vertexPath, const std::string& fragmentPath,
+                              const std::string& prelude, const std::vector<std::string>& defines) {
+    std::vector<std::string> paths;
+    paths.push_back(vertexPath);
+    paths.push_back(fragmentPath);
+    if (!tessControlPath.empty()) {
+        paths.push_back(tessControlPath);
+        paths.push_back(tessEvaluationPath);
+    }
+    std::vector<std::string> sources;
+    return readSources(paths, prelude, defines, sources) && beginLoad(sources);
 }
 
-bool ShaderManager::loadShaders(const std::string& vertexPath, const std::string& fragmentPath) {
-    std::cout << "Loading shaders from: " << vertexPath << " and " << fragmentPath << std::endl;
+bool ShaderManager::readSources(const std::vector<std::string>& paths, const std::string& prelude,
+                                const std::vector<std::string>& defines, std::vector<std::string>& sources) {
+    // One write, as this may run beside the render thread's logging
+    std::ostringstream message;
+    message << "Loading shaders from: " << paths[0] << " and " << paths[1];
+    if (paths.size() == 4) {
+        message << " with " << paths[2] << " and " << paths[3];
+    }
+    for (size_t i = 0; i < defines.size(); i++) {
+        message << (i == 0 ? " [" : " ") << defines[i] << (i + 1 == defines.size() ? "]" : "");
+    }
+    message << "\n";
+    std::cout << message.str() << std::flush;
     
-    // Read shader files
-    std::string vertexSource = readShaderFile(vertexPath);
-    std::string fragmentSource = readShaderFile(fragmentPath);
+    std::string injected;
+    for (size_t i = 0; i < defines.size(); i++) {
+        injected += "#define " + defines[i] + " 1\n";
+    }
+    injected += prelude;
     
-    if (vertexSource.empty() || fragmentSource.empty()) {
-        std::cerr << "Failed to read shader files" << std::endl;
-        return false;
+    sources.clear();
+    for (size_t i = 0; i < paths.size(); i++) {
+        std::vector<std::string> included;
+        std::string source = preprocess(paths[i], 0, included);
+        if (source.empty()) {
+            std::cerr << "Failed to read shader files" << std::endl;
+            sources.clear();
+            return false;
+        }
+        sources.push_back(injectPrelude(source, injected));
     }
+    return true;
+}
+
+bool ShaderManager::beginLoad(const std::vector<std::string>& sources) {
+    bool tessellated = sources.size() == 4;
+    const std::string& vertexSource = sources[0];
+    const std::string& fragmentSource = sources[1];
     
-    std::cout << "Shader files read successfully" << std::endl;
+    // A program linked by an earlier run skips compilation entirely
+    GLint binaryFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &binaryFormats);
+    bool useCache = !cacheDirectory.empty() && binaryFormats > 0;
+    binaryPath = useCache ? cachePath(sources) : "";
+    if (useCache && loadProgramBinary(binaryPath)) {
+        return true;
+    }
     
     // Compile shaders
     vertexShaderID = compileShader(vertexSource, GL_VERTEX_SHADER);
-    if (vertexShaderID == 0) {
-        std::cerr << "Failed to compile vertex shader" << std::endl;
-        return false;
-    }
-    
     fragmentShaderID = compileShader(fragmentSource, GL_FRAGMENT_SHADER);
-    if (fragmentShaderID == 0) {
-        std::cerr << "Failed to compile fragment shader" << std::endl;
-        glDeleteShader(vertexShaderID);
-        return false;
+    if (tessellated) {
+        tessControlShaderID = compileShader(sources[2], GL_TESS_CONTROL_SHADER);
+        tessEvaluationShaderID = compileShader(sources[3], GL_TESS_EVALUATION_SHADER);
     }
-    
-    // Create program and link shaders
     programID = glCreateProgram();
-    if (programID == 0) {
+    if (vertexShaderID == 0 || fragmentShaderID == 0 || programID == 0 ||
+        (tessellated && (tessControlShaderID == 0 || tessEvaluationShaderID == 0))) {
         std::cerr << "Failed to create shader program" << std::endl;
-        glDeleteShader(vertexShaderID);
-        glDeleteShader(fragmentShaderID);
+        discardPending();
         return false;
     }
     
+    // Linking is queued behind the compiles; nothing here waits for the driver
     glAttachShader(programID, vertexShaderID);
     glAttachShader(programID, fragmentShaderID);
+    if (tessellated) {
+        glAttachShader(programID, tessControlShaderID);
+        glAttachShader(programID, tessEvaluationShaderID);
+    }
+    if (useCache) {
+        glProgramParameteri(programID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
     glLinkProgram(programID);
+    return true;
+}
+
+void ShaderManager::setTessellationShaders(const std::string& controlPath, const std::string& evaluationPath) {
+    tessControlPath = controlPath;
+    tessEvaluationPath = evaluationPath;
+}
+
+void ShaderManager::enableParallelCompile() {
+    static bool checked = false;
+    if (checked) {
+        return;
+    }
+    checked = true;
     
-    checkLinkErrors(programID);
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++) {
+        const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+        if (name && strcmp(name, "GL_KHR_parallel_shader_compile") == 0) {
+            glMaxShaderCompilerThreadsKHR(0xFFFFFFFF);
+            parallelCompile = true;
+            std::cout << "Parallel shader compilation enabled" << std::endl;
+            return;
+        }
+    }
+}
+
+bool ShaderManager::isReady() const {
+    // Nothing queued: loaded from the cache, finished, or failed
+    if (programID == 0 || vertexShaderID == 0 || !parallelCompile) {
+        return true;
+    }
+    GLint complete = GL_FALSE;
+    glGetProgramiv(programID, GL_COMPLETION_STATUS_KHR, &complete);
+    return complete == GL_TRUE;
+}
+
+bool ShaderManager::finishLoad() {
+    if (programID == 0) {
+        return false;
+    }
     
-    // Check if linking was successful
-    GLint success;
-    glGetProgramiv(programID, GL_LINK_STATUS, &success);
-    if (!success) {
+    // Loaded from the binary cache by beginLoad
+    if (vertexShaderID == 0) {
+        reflectUniforms();
+        std::cout << "Shader program loaded from " << binaryPath << std::endl;
+        return true;
+    }
+    
+    bool compiled = checkCompileErrors(vertexShaderID, "VERTEX");
+    compiled = checkCompileErrors(fragmentShaderID, "FRAGMENT") && compiled;
+    if (tessControlShaderID) {
+        compiled = checkCompileErrors(tessControlShaderID, "TESS_CONTROL") && compiled;
+        compiled = checkCompileErrors(tessEvaluationShaderID, "TESS_EVALUATION") && compiled;
+    }
+    if (!compiled || !checkLinkErrors(programID)) {
         std::cerr << "Shader program linking failed" << std::endl;
-        glDeleteProgram(programID);
-        glDeleteShader(vertexShaderID);
-        glDeleteShader(fragmentShaderID);
-        programID = 0;
+        discardPending();
         return false;
     }
     
     // Delete shaders as they're linked into the program now
     glDeleteShader(vertexShaderID);
     glDeleteShader(fragmentShaderID);
+    if (tessControlShaderID) glDeleteShader(tessControlShaderID);
+    if (tessEvaluationShaderID) glDeleteShader(tessEvaluationShaderID);
+    vertexShaderID = 0;
+    fragmentShaderID = 0;
+    tessControlShaderID = 0;
+    tessEvaluationShaderID = 0;
+    
+    reflectUniforms();
+    if (!binaryPath.empty()) {
+        saveProgramBinary(binaryPath);
+    }
     
     std::cout << "Shaders compiled and linked successfully" << std::endl;
     return true;
 }
 
+void ShaderManager::discardPending() {
+    if (vertexShaderID) glDeleteShader(vertexShaderID);
+    if (fragmentShaderID) glDeleteShader(fragmentShaderID);
+    if (tessControlShaderID) glDeleteShader(tessControlShaderID);
+    if (tessEvaluationShaderID) glDeleteShader(tessEvaluationShaderID);
+    if (programID) glDeleteProgram(programID);
+    vertexShaderID = 0;
+    fragmentShaderID = 0;
+    tessControlShaderID = 0;
+    tessEvaluationShaderID = 0;
+    programID = 0;
+}
+
+void ShaderManager::reflectUniforms() {
+    uniformLocations.clear();
+    
+    GLint count = 0;
+    glGetProgramiv(programID, GL_ACTIVE_UNIFORMS, &count);
+    for (GLint i = 0; i < count; i++) {
+        GLchar name[256];
+        GLsizei length = 0;
+        GLint size;
+        GLenum type;
+        glGetActiveUniform(programID, i, sizeof(name), &length, &size, &type, name);
+        
+        // Members of uniform blocks have no location
+        GLint location = glGetUniformLocation(programID, name);
+        if (location == -1) {
+            continue;
+        }
+        
+        // Arrays are reported as "name[0]"
+        std::string key(name, length);
+        if (key.size() > 3 && key.compare(key.size() - 3, 3, "[0]") == 0) {
+            key.erase(key.size() - 3);
+        }
+        uniformLocations[key] = location;
+    }
+}
+
+GLint ShaderManager::findUniform(const std::string& name) const {
+    std::map<std::string, GLint>::const_iterator it = uniformLocations.find(name);
+    if (it != uniformLocations.end()) {
+        return it->second;
+    }
+    std::cerr << "Warning: uniform '" << name << "' not found" << std::endl;
+    uniformLocations[name] = -1;
+    return -1;
+}
+
 void ShaderManager::use() const {
     glUseProgram(programID);
 }
 
+void ShaderManager::bindUniformBlock(const std::string& name, GLuint binding) const {
+    // Blocks the linker optimised away are silently skipped
+    GLuint index = glGetUniformBlockIndex(programID, name.c_str());
+    if (index == GL_INVALID_INDEX) {
+        return;
+    }
+    glUniformBlockBinding(programID, index, binding);
+}
+
+void ShaderManager::setInt(const std::string& name, int value) const {
+    GLint location = findUniform(name);
+    if (location == -1) {
+        return;
+    }
+    glUniform1i(location, value);
+}
+
 void ShaderManager::setFloat(const std::string& name, float value) const {
-    GLint location = glGetUniformLocation(programID, name.c_str());
+    GLint location = findUniform(name);
     if (location == -1) {
-        std::cerr << "Warning: uniform '" << name << "' not found" << std::endl;
         return;
     }
     glUniform1f(location, value);
 }
 
 void ShaderManager::setVec2(const std::string& name, float x, float y) const {
-    GLint location = glGetUniformLocation(programID, name.c_str());
+    GLint location = findUniform(name);
     if (location == -1) {
-        std::cerr << "Warning: uniform '" << name << "' not found" << std::endl;
         return;
     }
     glUniform2f(location, x, y);
 }
 
 void ShaderManager::setVec3(const std::string& name, float x, float y, float z) const {
-    GLint location = glGetUniformLocation(programID, name.c_str());
+    GLint location = findUniform(name);
     if (location == -1) {
-        std::cerr << "Warning: uniform '" << name << "' not found" << std::endl;
         return;
     }
     glUniform3f(location, x, y, z);
 }
 
 void ShaderManager::setMat4(const std::string& name, const float* matrix) const {
-    GLint location = glGetUniformLocation(programID, name.c_str());
+    GLint location = findUniform(name);
     if (location == -1) {
-        std::cerr << "Warning: uniform '" << name << "' not found" << std::endl;
         return;
     }
     glUniformMatrix4fv(location, 1, GL_FALSE, matrix);
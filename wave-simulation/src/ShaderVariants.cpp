@@ -0,0 +1,138 @@
+#include "ShaderVariants.h"
+#include <algorithm>
+#include <cstdio>
+
+ShaderVariants::ShaderVariants(const std::string& vertexPath, const std::string& fragmentPath,
+                               const std::vector<std::string>& features, const std::string& prelude)
+    : vertexPath(vertexPath), fragmentPath(fragmentPath), prelude(prelude), features(features),
+      sourcesRead(false), submitted(0), submitOk(true) {
+}
+
+ShaderVariants::~ShaderVariants() {
+    if (reader.joinable()) {
+        reader.join();
+    }
+    clear();
+}
+
+void ShaderVariants::setTessellationShaders(const std::string& controlPath, const std::string& evaluationPath) {
+    tessControlPath = controlPath;
+    tessEvaluationPath = evaluationPath;
+}
+
+void ShaderVariants::clear() {
+    for (size_t i = 0; i < programs.size(); i++) {
+        delete programs[i];
+    }
+    programs.clear();
+}
+
+// No GL calls: runs on the reader thread for background builds
+void ShaderVariants::readSources() {
+    std::vector<std::string> paths;
+    paths.push_back(vertexPath);
+    paths.push_back(fragmentPath);
+    if (!tessControlPath.empty()) {
+        paths.push_back(tessControlPath);
+        paths.push_back(tessEvaluationPath);
+    }
+    
+    unsigned int count = 1u << features.size();
+    sources.assign(count, std::vector<std::string>());
+    for (unsigned int key = 0; key < count; key++) {
+        std::vector<std::string> defines;
+        for (size_t bit = 0; bit < features.size(); bit++) {
+            if (key & (1u << bit)) {
+                defines.push_back(features[bit]);
+            }
+        }
+        // An empty entry marks a variant whose files could not be read
+        ShaderManager::readSources(paths, prelude, defines, sources[key]);
+    }
+    sourcesRead.store(true, std::memory_order_release);
+}
+
+void ShaderVariants::submit(unsigned int key) {
+    ShaderManager* program = new ShaderManager();
+    programs.push_back(program);
+    submitOk = !sources[key].empty() && program->beginLoad(sources[key]) && submitOk;
+    std::vector<std::string>().swap(sources[key]);
+}
+
+bool ShaderVariants::compile() {
+    ShaderManager::enableParallelCompile();
+    clear();
+    sourcesRead.store(false);
+    submitted = 0;
+    submitOk = true;
+    readSources();
+    return finishCompile();
+}
+
+void ShaderVariants::beginCompile() {
+    ShaderManager::enableParallelCompile();
+    clear();
+    sourcesRead.store(false);
+    submitted = 0;
+    submitOk = true;
+    reader = std::thread(&ShaderVariants::readSources, this);
+}
+
+bool ShaderVariants::poll() {
+    if (!sourcesRead.load(std::memory_order_acquire)) {
+        return false;
+    }
+    if (reader.joinable()) {
+        reader.join();
+    }
+    if (submitted < sources.size()) {
+        bool all = ShaderManager::isParallelCompile();
+        do {
+            submit(submitted++);
+        } while (all && submitted < sources.size());
+        // Without parallel compilation the submission was the work; the
+        // next variant waits for the next call
+        return false;
+    }
+    for (size_t i = 0; i < programs.size(); i++) {
+        if (!programs[i]->isReady()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Waits for the sources and for compiles that are still running, and
+// submits whatever poll() had not yet
+bool ShaderVariants::finishCompile() {
+    if (reader.joinable()) {
+        reader.join();
+    }
+    while (submitted < sources.size()) {
+        submit(submitted++);
+    }
+    bool ok = submitOk;
+    cacheEntries.clear();
+    for (size_t i = 0; i < programs.size(); i++) {
+        if (programs[i]->finishLoad()) {
+            if (!programs[i]->getBinaryPath().empty()) {
+                cacheEntries.push_back(programs[i]->getBinaryPath());
+            }
+        } else {
+            ok = false;
+        }
+    }
+    if (!ok) {
+        clear();
+    }
+    return ok;
+}
+
+void ShaderVariants::evictCache(const ShaderVariants* live) const {
+    for (size_t i = 0; i < cacheEntries.size(); i++) {
+        if (!live || std::find(live->cacheEntries.begin(), live->cacheEntries.end(), cacheEntries[i]) ==
+                     live->cacheEntries.end()) {
+            std::remove(cacheEntries[i].c_str());
+        }
+    }
+}
@@ -0,0 +1,81 @@
+#include "ShaderWatcher.h"
+#include <cstring>
+#include <iostream>
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+ShaderWatcher::ShaderWatcher() : fd(-1), changed(false) {
+}
+
+ShaderWatcher::~ShaderWatcher() {
+#ifdef __linux__
+    if (fd >= 0) close(fd);
+#endif
+}
+
+// Editor swap and backup files are ignored
+bool ShaderWatcher::isShaderFile(const char* name) {
+    static const char* const EXTENSIONS[] = { ".vert", ".frag", ".glsl", ".tesc", ".tese" };
+    size_t length = strlen(name);
+    if (length == 0 || name[0] == '.') {
+        return false;
+    }
+    for (size_t i = 0; i < sizeof(EXTENSIONS) / sizeof(EXTENSIONS[0]); i++) {
+        size_t extension = strlen(EXTENSIONS[i]);
+        if (length > extension && strcmp(name + length - extension, EXTENSIONS[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ShaderWatcher::start(const std::string& directory) {
+#ifdef __linux__
+    fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        std::cerr << "Shader hot reload unavailable: inotify_init1 failed" << std::endl;
+        return false;
+    }
+    if (inotify_add_watch(fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE) < 0) {
+        std::cerr << "Shader hot reload unavailable: cannot watch " << directory << std::endl;
+        close(fd);
+        fd = -1;
+        return false;
+    }
+    std::cout << "Watching " << directory << " for shader changes" << std::endl;
+    return true;
+#else
+    (void)directory;
+    return false;
+#endif
+}
+
+bool ShaderWatcher::poll() {
+#ifdef __linux__
+    if (fd < 0) {
+        return false;
+    }
+    
+    // The descriptor is non-blocking; read until the queue is empty
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t length;
+    while ((length = read(fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length; ) {
+            const struct inotify_event* event = (const struct inotify_event*)p;
+            if (event->len > 0 && isShaderFile(event->name)) {
+                changed = true;
+                lastChange = std::chrono::steady_clock::now();
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+    
+    if (changed && std::chrono::steady_clock::now() - lastChange >= std::chrono::milliseconds(SETTLE_MS)) {
+        changed = false;
+        return true;
+    }
+#endif
+    return false;
+}
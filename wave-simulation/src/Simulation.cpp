@@ -0,0 +1,242 @@
+#include "Simulation.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iostream>
+
+static const int DEFAULT_SOLVER_SIZE = 256;
+static const int SOLVER_SUBSTEPS = 4;        // solver steps per 60 Hz tick
+static const float SOLVER_COURANT = 0.5f;
+static const float IMPULSE_RADIUS = 0.01f;   // fraction of the grid width
+static const float CLICK_IMPULSE = 1.0f;
+static const float DRAG_IMPULSE = 0.05f;     // added every step while held
+static const int DEFAULT_OCEAN_SIZE = 256;
+static const float RIPPLE_INTERVAL = 0.15f;  // seconds between ripples while held
+static const double MAX_LAG = 0.25;          // seconds behind schedule before the
+                                             // thread stops catching up
+
+Simulation::Simulation()
+    : workerPool(nullptr), solver(nullptr), solverSize(DEFAULT_SOLVER_SIZE),
+      ocean(nullptr), oceanSize(DEFAULT_OCEAN_SIZE), oceanSpectrum(OceanSpectrum::PHILLIPS),
+      oceanTime(0.0f), mode(MODE_ANALYTIC), time(0.0f),
+      rippleVersion(0), lastRippleTime(0.0f), parameters(defaultParameters()),
+      pointerU(-1.0f), pointerV(-1.0f), pressed(false), clicked(false),
+      heightStream(nullptr), publication(0), publishedTime(0.0f), lastMode(MODE_ANALYTIC), lastSize(0),
+      running(false), stepSeconds(0.0f), stepCount(0), stepMilliseconds(0.0) {
+}
+
+Simulation::~Simulation() {
+    stop();
+    delete solver;
+    delete ocean;
+    delete workerPool;
+}
+
+double Simulation::now() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Simulation::Parameters Simulation::defaultParameters() {
+    Parameters defaults = { 1.0f, 0.2f, 5.0f };
+    return defaults;
+}
+
+void Simulation::initialize() {
+    workerPool = new WorkerPool();
+    solver = new WaveSolver(solverSize, workerPool);
+    solver->setCourant(SOLVER_COURANT);
+    solver->setSubsteps(SOLVER_SUBSTEPS);
+
+    std::cout << "Wave solver: " << solverSize << "x" << solverSize << " cells, "
+              << workerPool->size() << " threads, " << solver->getKernelName() << " kernel" << std::endl;
+
+    // The reader always has a snapshot, even before the first step
+    publish();
+}
+
+bool Simulation::submit(Command command) {
+    if (command.timestamp == 0.0) {
+        command.timestamp = now();
+    }
+    return commands.push(command);
+}
+
+// Runs on the simulation's thread, like everything that resets or creates
+// engines
+void Simulation::setMode(Mode newMode) {
+    if (newMode == mode) {
+        return;
+    }
+    if (newMode == MODE_SOLVER) {
+        solver->reset();
+    }
+    if (newMode == MODE_OCEAN && !ocean) {
+        ocean = new OceanSpectrum(oceanSize, workerPool, oceanSpectrum);
+        std::cout << "FFT ocean: " << oceanSize << "x" << oceanSize << ", "
+                  << ocean->getSpectrumName() << " spectrum" << std::endl;
+    }
+    mode = newMode;
+}
+
+void Simulation::apply(const Command& command) {
+    switch (command.type) {
+        case Command::SET_WAVE_SPEED: parameters.waveSpeed = command.x; break;
+        case Command::SET_WAVE_HEIGHT: parameters.waveHeight = command.x; break;
+        case Command::SET_WAVE_FREQUENCY: parameters.waveFrequency = command.x; break;
+        case Command::SET_MODE: setMode((Mode)command.mode); break;
+        case Command::POINTER_MOVE:
+            pointerU = command.x;
+            pointerV = command.y;
+            break;
+        case Command::POINTER_PRESS:
+            // A press and release within one step still counts as a click
+            clicked = clicked || !pressed;
+            pressed = true;
+            break;
+        case Command::POINTER_RELEASE: pressed = false; break;
+    }
+}
+
+bool Simulation::pointerInside() const {
+    return pointerU >= 0.0f && pointerU <= 1.0f && pointerV >= 0.0f && pointerV <= 1.0f;
+}
+
+void Simulation::step(float deltaTime) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    clicked = false;
+    {
+        std::lock_guard<std::mutex> lock(commandMutex);
+        Command command;
+        while (commands.pop(command)) {
+            apply(command);
+        }
+        stepCount.fetch_add(1, std::memory_order_release);
+    }
+    time += deltaTime;
+
+    int rippleCount = ripples.size();
+    ripples.update(time);
+    if (ripples.size() != rippleCount) {
+        rippleVersion++;
+    }
+
+    bool inside = pointerInside();
+    if (mode == MODE_ANALYTIC) {
+        if (inside && (clicked || (pressed && time - lastRippleTime >= RIPPLE_INTERVAL))) {
+            // Pointer mapped onto the [-1, 1] mesh
+            ripples.emit(pointerU * 2.0f - 1.0f, pointerV * 2.0f - 1.0f, time);
+            rippleVersion++;
+            lastRippleTime = time;
+        }
+    } else if (mode == MODE_SOLVER) {
+        if (inside && clicked) {
+            solver->addImpulse(pointerU, pointerV, IMPULSE_RADIUS, CLICK_IMPULSE);
+        }
+        if (inside && pressed) {
+            solver->addImpulse(pointerU, pointerV, IMPULSE_RADIUS, DRAG_IMPULSE);
+        }
+        solver->advance(deltaTime * parameters.waveSpeed);
+    } else if (mode == MODE_OCEAN) {
+        oceanTime += deltaTime * parameters.waveSpeed;
+        ocean->update(oceanTime);
+    }
+    std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+    stepMilliseconds += elapsed.count();
+    publish();
+}
+
+// The engine's heights are copied once, row by row, into the next stream
+// region, the only CPU copy on their way to the GPU. When the reader and the
+// GPU still hold every region, the step is not published at all; the reader
+// keeps the last one, and the next step that finds a region is blended from it.
+void Simulation::publish() {
+    Snapshot& snapshot = snapshots.writeBuffer();
+    const float* heights = nullptr;
+    int size = 0;
+    int stride = 0;
+    if (mode == MODE_SOLVER) {
+        heights = solver->getHeights();
+        size = solver->getSize();
+        stride = solver->getStride();
+    } else if (mode == MODE_OCEAN) {
+        heights = ocean->getHeights();
+        size = ocean->getSize();
+        stride = ocean->getStride();
+    }
+    if (!heightStream) {
+        size = 0;
+    }
+    if (size > 0) {
+        float* region = heightStream->region(publication);
+        if (!region) {
+            return;
+        }
+        for (int row = 0; row < size; row++) {
+            std::memcpy(region + (size_t)row * size, heights + (size_t)row * stride, size * sizeof(float));
+        }
+        // Right after a mode change there is nothing to blend from
+        bool blend = publication > 0 && lastMode == mode && lastSize == size;
+        snapshot.heights = publication;
+        snapshot.previousHeights = blend ? publication - 1 : publication;
+        publication++;
+    }
+    lastMode = mode;
+    lastSize = size;
+
+    snapshot.previousTime = publishedTime;
+    snapshot.time = time;
+    snapshot.mode = mode;
+    snapshot.parameters = parameters;
+    snapshot.size = size;
+    snapshot.periodic = mode == MODE_OCEAN;
+    publishedTime = time;
+
+    snapshot.rippleVersion = rippleVersion;
+    snapshot.rippleCount = ripples.size();
+    for (int i = 0; i < ripples.size(); i++) {
+        snapshot.ripples[i] = ripples[i];
+    }
+    snapshot.stepMilliseconds = stepMilliseconds;
+    snapshot.publishedAt = now();
+    snapshots.publish();
+}
+
+const Simulation::Snapshot& Simulation::acquire() {
+    snapshots.update();
+    return snapshots.readBuffer();
+}
+
+// Sleeps until each step is due. A step that overruns delays the next ones,
+// which then follow back to back until the thread is on schedule again; more
+// than MAX_LAG behind, it gives up on the missed time rather than spiral.
+void Simulation::run() {
+    std::chrono::duration<double> interval(stepSeconds);
+    std::chrono::steady_clock::time_point due = std::chrono::steady_clock::now();
+    while (running.load()) {
+        step(stepSeconds);
+        due += std::chrono::duration_cast<std::chrono::steady_clock::duration>(interval);
+        std::chrono::steady_clock::time_point current = std::chrono::steady_clock::now();
+        if (current - due > std::chrono::duration<double>(MAX_LAG)) {
+            due = current;
+        }
+        std::this_thread::sleep_until(due);
+    }
+}
+
+void Simulation::start(float seconds) {
+    if (isRunning()) {
+        return;
+    }
+    stepSeconds = seconds;
+    running.store(true);
+    thread = std::thread(&Simulation::run, this);
+    std::cout << "Simulation thread: " << 1.0f / seconds << " steps per second" << std::endl;
+}
+
+void Simulation::stop() {
+    if (!isRunning()) {
+        return;
+    }
+    running.store(false);
+    thread.join();
+}
@@ -0,0 +1,532 @@
+#include "WaveField.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "WaveFunction.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAVE_X86 1
+#endif
+
+// As in shaders/ripples.glsl
+static const float RIPPLE_EPSILON = 0.001f;
+static const float RIPPLE_WAVENUMBER = 10.0f;   // radians per unit
+static const float RIPPLE_FREQUENCY = 8.0f;     // radians per second
+static const float RIPPLE_DECAY = 2.0f;         // per unit
+static const float RIPPLE_MIN_DISTANCE = 1e-6f;
+
+// Scales the sums by the Wave block's heightScale, as the height field does,
+// and turns the slopes into the upward unit normal
+static inline void storeQuery(const WaveField::State& s, size_t i, float height, float dx, float dz, float rate,
+                              float* h, float* nx, float* nz, float* vy) {
+    float gx = dx * s.heightScale;
+    float gz = dz * s.heightScale;
+    float inv = 1.0f / std::sqrt(1.0f + gx * gx + gz * gz);
+    h[i] = height * s.heightScale;
+    nx[i] = -gx * inv;
+    nz[i] = -gz * inv;
+    if (vy) {
+        vy[i] = rate * s.heightScale;
+    }
+}
+
+static void sampleScalar(const WaveField::State& s, const float* xs, const float* zs, size_t begin, size_t end,
+                         float* h, float* nx, float* nz, float* vy) {
+    for (size_t i = begin; i < end; i++) {
+        WaveFunction::Sample wave = WaveFunction::evaluate(xs[i], zs[i], s.scaledTime, s.frequency);
+        float height = wave.height;
+        float dx = wave.dx;
+        float dz = wave.dy;
+        float rate = vy ? WaveFunction::rate(xs[i], zs[i], s.scaledTime, s.frequency) * s.waveSpeed : 0.0f;
+        for (int r = 0; r < s.rippleCount; r++) {
+            const WaveField::ActiveRipple& ripple = s.ripples[r];
+            float ox = xs[i] - ripple.x;
+            float oz = zs[i] - ripple.z;
+            float dist2 = ox * ox + oz * oz;
+            if (dist2 > ripple.radius2) {
+                continue;
+            }
+            float dist = std::sqrt(dist2);
+            float phase = dist * RIPPLE_WAVENUMBER - ripple.age * RIPPLE_FREQUENCY;
+            float sinPhase = std::sin(phase);
+            float cosPhase = std::cos(phase);
+            float decay = std::exp(-dist * RIPPLE_DECAY);
+            float envelope = decay * ripple.strength;
+            float slope = envelope * (RIPPLE_WAVENUMBER * cosPhase - RIPPLE_DECAY * sinPhase)
+                        / std::max(dist, RIPPLE_MIN_DISTANCE);
+            height += sinPhase * envelope;
+            dx += ox * slope;
+            dz += oz * slope;
+            rate += sinPhase * decay * ripple.strengthRate - RIPPLE_FREQUENCY * cosPhase * envelope;
+        }
+        storeQuery(s, i, height, dx, dz, rate, h, nx, nz, vy);
+    }
+}
+
+#ifdef WAVE_X86
+// sin and cos after Cephes' sinf and cosf: the angle is reduced by the
+// nearest multiple j of pi/2, subtracted in three parts so the remainder in
+// [-pi/4, pi/4] stays exact, and both polynomials are evaluated on it. The
+// quadrant j & 3 then swaps them and picks the signs.
+static const float TWO_OVER_PI = 0.636619772f;
+static const float PIO2_1 = 1.5703125f;
+static const float PIO2_2 = 4.837512969970703125e-4f;
+static const float PIO2_3 = 7.54978995489188216e-8f;
+static const float SIN_P0 = -1.9515295891e-4f;
+static const float SIN_P1 = 8.3321608736e-3f;
+static const float SIN_P2 = -1.6666654611e-1f;
+static const float COS_P0 = 2.443315711809948e-5f;
+static const float COS_P1 = -1.388731625493765e-3f;
+static const float COS_P2 = 4.166664568298827e-2f;
+
+// exp after Cephes' expf: x = n ln 2 + r with |r| <= ln 2 / 2, a polynomial
+// for e^r and 2^n built in the exponent bits
+static const float LOG2E = 1.44269504088896341f;
+static const float LN2_HI = 0.693359375f;
+static const float LN2_LO = -2.12194440e-4f;
+static const float EXP_MIN = -87.0f;   // keeps 2^n normal
+static const float EXP_P0 = 1.9875691500e-4f;
+static const float EXP_P1 = 1.3981999507e-3f;
+static const float EXP_P2 = 8.3334519073e-3f;
+static const float EXP_P3 = 4.1665795894e-2f;
+static const float EXP_P4 = 1.6666665459e-1f;
+static const float EXP_P5 = 5.0000001201e-1f;
+
+static inline __m128 selectSSE(__m128 mask, __m128 a, __m128 b) {
+    return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+static inline void sincosSSE(__m128 x, __m128& s, __m128& c) {
+    __m128i q = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(TWO_OVER_PI)));
+    __m128 j = _mm_cvtepi32_ps(q);
+    __m128 y = _mm_sub_ps(x, _mm_mul_ps(j, _mm_set1_ps(PIO2_1)));
+    y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(PIO2_2)));
+    y = _mm_sub_ps(y, _mm_mul_ps(j, _mm_set1_ps(PIO2_3)));
+    __m128 z = _mm_mul_ps(y, y);
+
+    __m128 sp = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(SIN_P0), z), _mm_set1_ps(SIN_P1));
+    sp = _mm_add_ps(_mm_mul_ps(sp, z), _mm_set1_ps(SIN_P2));
+    sp = _mm_add_ps(_mm_mul_ps(_mm_mul_ps(sp, z), y), y);
+    __m128 cp = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(COS_P0), z), _mm_set1_ps(COS_P1));
+    cp = _mm_add_ps(_mm_mul_ps(cp, z), _mm_set1_ps(COS_P2));
+    cp = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(_mm_mul_ps(cp, z), z), _mm_mul_ps(_mm_set1_ps(0.5f), z)),
+                    _mm_set1_ps(1.0f));
+
+    __m128i one = _mm_set1_epi32(1);
+    __m128i two = _mm_set1_epi32(2);
+    __m128 swap = _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    __m128 sinSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, two), 30));
+    __m128 cosSign = _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(_mm_add_epi32(q, one), two), 30));
+    s = _mm_xor_ps(selectSSE(swap, cp, sp), sinSign);
+    c = _mm_xor_ps(selectSSE(swap, sp, cp), cosSign);
+}
+
+// 1 / sqrt(x) from the 12-bit estimate and one Newton step
+static inline __m128 rsqrtSSE(__m128 x) {
+    __m128 y = _mm_rsqrt_ps(x);
+    __m128 halfX = _mm_mul_ps(_mm_set1_ps(0.5f), x);
+    return _mm_mul_ps(y, _mm_sub_ps(_mm_set1_ps(1.5f), _mm_mul_ps(halfX, _mm_mul_ps(y, y))));
+}
+
+static inline __m128 expSSE(__m128 x) {
+    x = _mm_max_ps(x, _mm_set1_ps(EXP_MIN));
+    __m128i n = _mm_cvtps_epi32(_mm_mul_ps(x, _mm_set1_ps(LOG2E)));
+    __m128 fn = _mm_cvtepi32_ps(n);
+    x = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(LN2_HI)));
+    x = _mm_sub_ps(x, _mm_mul_ps(fn, _mm_set1_ps(LN2_LO)));
+    __m128 y = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(EXP_P0), x), _mm_set1_ps(EXP_P1));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P2));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P3));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P4));
+    y = _mm_add_ps(_mm_mul_ps(y, x), _mm_set1_ps(EXP_P5));
+    y = _mm_add_ps(_mm_add_ps(_mm_mul_ps(y, _mm_mul_ps(x, x)), x), _mm_set1_ps(1.0f));
+    __m128 scale = _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23));
+    return _mm_mul_ps(y, scale);
+}
+
+static void sampleSSE(const WaveField::State& s, const float* xs, const float* zs, size_t begin, size_t end,
+                      float* h, float* nx, float* nz, float* vy) {
+    const __m128 zero = _mm_setzero_ps();
+    const __m128 one = _mm_set1_ps(1.0f);
+    size_t i = begin;
+    for (; i + 4 <= end; i += 4) {
+        __m128 x = _mm_loadu_ps(xs + i);
+        __m128 z = _mm_loadu_ps(zs + i);
+        __m128 height = zero, dx = zero, dz = zero, rate = zero;
+
+        for (int k = 0; k < WaveFunction::TERM_COUNT; k++) {
+            const WaveFunction::Term& term = WaveFunction::TERMS[k];
+            __m128 sx, cx, sz, cz;
+            sincosSSE(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(term.waveX * s.frequency), x),
+                                 _mm_set1_ps(term.speedX * s.scaledTime)), sx, cx);
+            sincosSSE(_mm_add_ps(_mm_mul_ps(_mm_set1_ps(term.waveY * s.frequency), z),
+                                 _mm_set1_ps(term.speedY * s.scaledTime)), sz, cz);
+            __m128 bx = term.basisX == WaveFunction::SIN ? sx : cx;
+            __m128 bz = term.basisY == WaveFunction::SIN ? sz : cz;
+            __m128 slopeX = term.basisX == WaveFunction::SIN ? cx : _mm_sub_ps(zero, sx);
+            __m128 slopeZ = term.basisY == WaveFunction::SIN ? cz : _mm_sub_ps(zero, sz);
+            height = _mm_add_ps(height, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(term.amplitude), bx), bz));
+            dx = _mm_add_ps(dx, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(term.amplitude * term.waveX * s.frequency),
+                                                      slopeX), bz));
+            dz = _mm_add_ps(dz, _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(term.amplitude * term.waveY * s.frequency),
+                                                      bx), slopeZ));
+            rate = _mm_add_ps(rate, _mm_mul_ps(_mm_set1_ps(term.amplitude),
+                                               _mm_add_ps(_mm_mul_ps(_mm_mul_ps(_mm_set1_ps(term.speedX), slopeX), bz),
+                                                          _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(term.speedY), bx), slopeZ))));
+        }
+        rate = _mm_mul_ps(rate, _mm_set1_ps(s.waveSpeed));
+
+        for (int r = 0; r < s.rippleCount; r++) {
+            const WaveField::ActiveRipple& ripple = s.ripples[r];
+            __m128 ox = _mm_sub_ps(x, _mm_set1_ps(ripple.x));
+            __m128 oz = _mm_sub_ps(z, _mm_set1_ps(ripple.z));
+            __m128 dist2 = _mm_add_ps(_mm_mul_ps(ox, ox), _mm_mul_ps(oz, oz));
+            __m128 reached = _mm_cmple_ps(dist2, _mm_set1_ps(ripple.radius2));
+            if (!_mm_movemask_ps(reached)) {
+                continue;
+            }
+            __m128 invDist = rsqrtSSE(_mm_max_ps(dist2, _mm_set1_ps(RIPPLE_MIN_DISTANCE * RIPPLE_MIN_DISTANCE)));
+            __m128 dist = _mm_mul_ps(dist2, invDist);
+            __m128 sinPhase, cosPhase;
+            sincosSSE(_mm_sub_ps(_mm_mul_ps(dist, _mm_set1_ps(RIPPLE_WAVENUMBER)),
+                                 _mm_set1_ps(ripple.age * RIPPLE_FREQUENCY)), sinPhase, cosPhase);
+            __m128 decay = expSSE(_mm_mul_ps(dist, _mm_set1_ps(-RIPPLE_DECAY)));
+            __m128 envelope = _mm_mul_ps(decay, _mm_set1_ps(ripple.strength));
+            __m128 slope = _mm_mul_ps(_mm_mul_ps(envelope, _mm_sub_ps(_mm_mul_ps(_mm_set1_ps(RIPPLE_WAVENUMBER), cosPhase),
+                                                                       _mm_mul_ps(_mm_set1_ps(RIPPLE_DECAY), sinPhase))),
+                                      invDist);
+            height = _mm_add_ps(height, _mm_and_ps(reached, _mm_mul_ps(sinPhase, envelope)));
+            dx = _mm_add_ps(dx, _mm_and_ps(reached, _mm_mul_ps(ox, slope)));
+            dz = _mm_add_ps(dz, _mm_and_ps(reached, _mm_mul_ps(oz, slope)));
+            __m128 change = _mm_sub_ps(_mm_mul_ps(_mm_mul_ps(sinPhase, decay), _mm_set1_ps(ripple.strengthRate)),
+                                       _mm_mul_ps(_mm_mul_ps(_mm_set1_ps(RIPPLE_FREQUENCY), cosPhase), envelope));
+            rate = _mm_add_ps(rate, _mm_and_ps(reached, change));
+        }
+
+        __m128 scale = _mm_set1_ps(s.heightScale);
+        __m128 gx = _mm_mul_ps(dx, scale);
+        __m128 gz = _mm_mul_ps(dz, scale);
+        __m128 inv = rsqrtSSE(_mm_add_ps(_mm_add_ps(one, _mm_mul_ps(gx, gx)), _mm_mul_ps(gz, gz)));
+        _mm_storeu_ps(h + i, _mm_mul_ps(height, scale));
+        _mm_storeu_ps(nx + i, _mm_mul_ps(_mm_sub_ps(zero, gx), inv));
+        _mm_storeu_ps(nz + i, _mm_mul_ps(_mm_sub_ps(zero, gz), inv));
+        if (vy) {
+            _mm_storeu_ps(vy + i, _mm_mul_ps(rate, scale));
+        }
+    }
+    sampleScalar(s, xs, zs, i, end, h, nx, nz, vy);
+}
+
+__attribute__((target("avx2,fma")))
+static inline void sincosAVX2(__m256 x, __m256& s, __m256& c) {
+    __m256i q = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(TWO_OVER_PI)));
+    __m256 j = _mm256_cvtepi32_ps(q);
+    __m256 y = _mm256_fnmadd_ps(j, _mm256_set1_ps(PIO2_1), x);
+    y = _mm256_fnmadd_ps(j, _mm256_set1_ps(PIO2_2), y);
+    y = _mm256_fnmadd_ps(j, _mm256_set1_ps(PIO2_3), y);
+    __m256 z = _mm256_mul_ps(y, y);
+
+    __m256 sp = _mm256_fmadd_ps(_mm256_set1_ps(SIN_P0), z, _mm256_set1_ps(SIN_P1));
+    sp = _mm256_fmadd_ps(sp, z, _mm256_set1_ps(SIN_P2));
+    sp = _mm256_fmadd_ps(_mm256_mul_ps(sp, z), y, y);
+    __m256 cp = _mm256_fmadd_ps(_mm256_set1_ps(COS_P0), z, _mm256_set1_ps(COS_P1));
+    cp = _mm256_fmadd_ps(cp, z, _mm256_set1_ps(COS_P2));
+    cp = _mm256_fmadd_ps(_mm256_mul_ps(cp, z), z, _mm256_fnmadd_ps(_mm256_set1_ps(0.5f), z, _mm256_set1_ps(1.0f)));
+
+    __m256i one = _mm256_set1_epi32(1);
+    __m256i two = _mm256_set1_epi32(2);
+    __m256 swap = _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+    __m256 sinSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, two), 30));
+    __m256 cosSign = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(_mm256_add_epi32(q, one), two), 30));
+    s = _mm256_xor_ps(_mm256_blendv_ps(sp, cp, swap), sinSign);
+    c = _mm256_xor_ps(_mm256_blendv_ps(cp, sp, swap), cosSign);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 rsqrtAVX2(__m256 x) {
+    __m256 y = _mm256_rsqrt_ps(x);
+    __m256 halfX = _mm256_mul_ps(_mm256_set1_ps(0.5f), x);
+    return _mm256_mul_ps(y, _mm256_fnmadd_ps(halfX, _mm256_mul_ps(y, y), _mm256_set1_ps(1.5f)));
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m256 expAVX2(__m256 x) {
+    x = _mm256_max_ps(x, _mm256_set1_ps(EXP_MIN));
+    __m256i n = _mm256_cvtps_epi32(_mm256_mul_ps(x, _mm256_set1_ps(LOG2E)));
+    __m256 fn = _mm256_cvtepi32_ps(n);
+    x = _mm256_fnmadd_ps(fn, _mm256_set1_ps(LN2_HI), x);
+    x = _mm256_fnmadd_ps(fn, _mm256_set1_ps(LN2_LO), x);
+    __m256 y = _mm256_fmadd_ps(_mm256_set1_ps(EXP_P0), x, _mm256_set1_ps(EXP_P1));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P2));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P3));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P4));
+    y = _mm256_fmadd_ps(y, x, _mm256_set1_ps(EXP_P5));
+    y = _mm256_add_ps(_mm256_fmadd_ps(y, _mm256_mul_ps(x, x), x), _mm256_set1_ps(1.0f));
+    __m256 scale = _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23));
+    return _mm256_mul_ps(y, scale);
+}
+
+__attribute__((target("avx2,fma")))
+static void sampleAVX2(const WaveField::State& s, const float* xs, const float* zs, size_t begin, size_t end,
+                       float* h, float* nx, float* nz, float* vy) {
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    size_t i = begin;
+    for (; i + 8 <= end; i += 8) {
+        __m256 x = _mm256_loadu_ps(xs + i);
+        __m256 z = _mm256_loadu_ps(zs + i);
+        __m256 height = zero, dx = zero, dz = zero, rate = zero;
+
+        for (int k = 0; k < WaveFunction::TERM_COUNT; k++) {
+            const WaveFunction::Term& term = WaveFunction::TERMS[k];
+            __m256 sx, cx, sz, cz;
+            sincosAVX2(_mm256_fmadd_ps(_mm256_set1_ps(term.waveX * s.frequency), x,
+                                       _mm256_set1_ps(term.speedX * s.scaledTime)), sx, cx);
+            sincosAVX2(_mm256_fmadd_ps(_mm256_set1_ps(term.waveY * s.frequency), z,
+                                       _mm256_set1_ps(term.speedY * s.scaledTime)), sz, cz);
+            __m256 bx = term.basisX == WaveFunction::SIN ? sx : cx;
+            __m256 bz = term.basisY == WaveFunction::SIN ? sz : cz;
+            __m256 slopeX = term.basisX == WaveFunction::SIN ? cx : _mm256_sub_ps(zero, sx);
+            __m256 slopeZ = term.basisY == WaveFunction::SIN ? cz : _mm256_sub_ps(zero, sz);
+            height = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_set1_ps(term.amplitude), bx), bz, height);
+            dx = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_set1_ps(term.amplitude * term.waveX * s.frequency), slopeX),
+                                 bz, dx);
+            dz = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_set1_ps(term.amplitude * term.waveY * s.frequency), bx),
+                                 slopeZ, dz);
+            __m256 change = _mm256_fmadd_ps(_mm256_mul_ps(_mm256_set1_ps(term.speedX), slopeX), bz,
+                                            _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(term.speedY), bx), slopeZ));
+            rate = _mm256_fmadd_ps(_mm256_set1_ps(term.amplitude), change, rate);
+        }
+        rate = _mm256_mul_ps(rate, _mm256_set1_ps(s.waveSpeed));
+
+        for (int r = 0; r < s.rippleCount; r++) {
+            const WaveField::ActiveRipple& ripple = s.ripples[r];
+            __m256 ox = _mm256_sub_ps(x, _mm256_set1_ps(ripple.x));
+            __m256 oz = _mm256_sub_ps(z, _mm256_set1_ps(ripple.z));
+            __m256 dist2 = _mm256_fmadd_ps(ox, ox, _mm256_mul_ps(oz, oz));
+            __m256 reached = _mm256_cmp_ps(dist2, _mm256_set1_ps(ripple.radius2), _CMP_LE_OQ);
+            if (!_mm256_movemask_ps(reached)) {
+                continue;
+            }
+            __m256 invDist = rsqrtAVX2(_mm256_max_ps(dist2, _mm256_set1_ps(RIPPLE_MIN_DISTANCE * RIPPLE_MIN_DISTANCE)));
+            __m256 dist = _mm256_mul_ps(dist2, invDist);
+            __m256 sinPhase, cosPhase;
+            sincosAVX2(_mm256_fmsub_ps(dist, _mm256_set1_ps(RIPPLE_WAVENUMBER),
+                                       _mm256_set1_ps(ripple.age * RIPPLE_FREQUENCY)), sinPhase, cosPhase);
+            __m256 decay = expAVX2(_mm256_mul_ps(dist, _mm256_set1_ps(-RIPPLE_DECAY)));
+            __m256 envelope = _mm256_mul_ps(decay, _mm256_set1_ps(ripple.strength));
+            __m256 radial = _mm256_fmsub_ps(_mm256_set1_ps(RIPPLE_WAVENUMBER), cosPhase,
+                                            _mm256_mul_ps(_mm256_set1_ps(RIPPLE_DECAY), sinPhase));
+            __m256 slope = _mm256_mul_ps(_mm256_mul_ps(envelope, radial), invDist);
+            height = _mm256_add_ps(height, _mm256_and_ps(reached, _mm256_mul_ps(sinPhase, envelope)));
+            dx = _mm256_add_ps(dx, _mm256_and_ps(reached, _mm256_mul_ps(ox, slope)));
+            dz = _mm256_add_ps(dz, _mm256_and_ps(reached, _mm256_mul_ps(oz, slope)));
+            __m256 change = _mm256_fmsub_ps(_mm256_mul_ps(sinPhase, decay), _mm256_set1_ps(ripple.strengthRate),
+                                            _mm256_mul_ps(_mm256_mul_ps(_mm256_set1_ps(RIPPLE_FREQUENCY), cosPhase),
+                                                          envelope));
+            rate = _mm256_add_ps(rate, _mm256_and_ps(reached, change));
+        }
+
+        __m256 scale = _mm256_set1_ps(s.heightScale);
+        __m256 gx = _mm256_mul_ps(dx, scale);
+        __m256 gz = _mm256_mul_ps(dz, scale);
+        __m256 inv = rsqrtAVX2(_mm256_fmadd_ps(gx, gx, _mm256_fmadd_ps(gz, gz, one)));
+        _mm256_storeu_ps(h + i, _mm256_mul_ps(height, scale));
+        _mm256_storeu_ps(nx + i, _mm256_mul_ps(_mm256_sub_ps(zero, gx), inv));
+        _mm256_storeu_ps(nz + i, _mm256_mul_ps(_mm256_sub_ps(zero, gz), inv));
+        if (vy) {
+            _mm256_storeu_ps(vy + i, _mm256_mul_ps(rate, scale));
+        }
+    }
+    sampleScalar(s, xs, zs, i, end, h, nx, nz, vy);
+}
+#endif
+
+// Solver and ocean mode
+
+static inline int gridIndex(int i, int size, bool periodic) {
+    if (periodic) {
+        return ((i % size) + size) % size;
+    }
+    return std::min(std::max(i, 0), size - 1);
+}
+
+static inline float gridHeight(const WaveField::State& s, int column, int row) {
+    size_t k = (size_t)gridIndex(row, s.size, s.periodic) * s.size + gridIndex(column, s.size, s.periodic);
+    return s.previous[k] + (s.current[k] - s.previous[k]) * s.blend;
+}
+
+// One texel of the gradient pass: the blended height and its central
+// differences with the engine's wrap, plus the height's rate of change
+static inline void gridTexel(const WaveField::State& s, int column, int row,
+                             float& height, float& dx, float& dz, float& rate) {
+    size_t k = (size_t)row * s.size + column;
+    height = s.previous[k] + (s.current[k] - s.previous[k]) * s.blend;
+    rate = (s.current[k] - s.previous[k]) * s.stepRate;
+    // Neighbouring texels are 2 / size apart on the mesh
+    dx = (gridHeight(s, column + 1, row) - gridHeight(s, column - 1, row)) * s.size * 0.25f;
+    dz = (gridHeight(s, column, row + 1) - gridHeight(s, column, row - 1)) * s.size * 0.25f;
+}
+
+// Bilinear filtering of the field texture at the mesh position, which is
+// clamped to its edges whatever the engine's wrap
+static void sampleGrid(const WaveField::State& s, const float* xs, const float* zs, size_t begin, size_t end,
+                       float* h, float* nx, float* nz, float* vy) {
+    const int size = s.size;
+    for (size_t i = begin; i < end; i++) {
+        float u = (xs[i] * 0.5f + 0.5f) * size - 0.5f;
+        float v = (zs[i] * 0.5f + 0.5f) * size - 0.5f;
+        float u0 = std::floor(u);
+        float v0 = std::floor(v);
+        float fu = u - u0;
+        float fv = v - v0;
+        int columns[2] = { std::min(std::max((int)u0, 0), size - 1), std::min(std::max((int)u0 + 1, 0), size - 1) };
+        int rows[2] = { std::min(std::max((int)v0, 0), size - 1), std::min(std::max((int)v0 + 1, 0), size - 1) };
+
+        float height = 0.0f, dx = 0.0f, dz = 0.0f, rate = 0.0f;
+        for (int r = 0; r < 2; r++) {
+            for (int c = 0; c < 2; c++) {
+                float weight = (c ? fu : 1.0f - fu) * (r ? fv : 1.0f - fv);
+                float th, tdx, tdz, trate;
+                gridTexel(s, columns[c], rows[r], th, tdx, tdz, trate);
+                height += th * weight;
+                dx += tdx * weight;
+                dz += tdz * weight;
+                rate += trate * weight;
+            }
+        }
+        storeQuery(s, i, height, dx, dz, rate, h, nx, nz, vy);
+    }
+}
+
+struct WaveField::Kernel {
+    const char* name;
+    void (*sample)(const WaveField::State&, const float*, const float*, size_t, size_t,
+                   float*, float*, float*, float*);
+};
+
+static const WaveField::Kernel SCALAR_KERNEL = { "scalar", sampleScalar };
+#ifdef WAVE_X86
+static const WaveField::Kernel SSE_KERNEL = { "sse", sampleSSE };
+static const WaveField::Kernel AVX2_KERNEL = { "avx2", sampleAVX2 };
+#endif
+
+static const WaveField::Kernel* selectKernel() {
+#ifdef WAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return &AVX2_KERNEL;
+    }
+    return &SSE_KERNEL;
+#else
+    return &SCALAR_KERNEL;
+#endif
+}
+
+WaveField::WaveField(int threads)
+    : gridSize(0), threads(threads), pool(nullptr), kernel(selectKernel()) {
+    grids[0] = grids[1] = nullptr;
+    gridPublications[0] = gridPublications[1] = 0;
+    gridLoaded[0] = gridLoaded[1] = false;
+    setState(Simulation::Snapshot(), 1.0f, nullptr);
+}
+
+WaveField::~WaveField() {
+    delete pool;
+    delete[] grids[0];
+    delete[] grids[1];
+}
+
+// Returns the grid holding publication, copying it from the stream into the
+// one other than keep if neither does
+const float* WaveField::loadGrid(HeightStream& stream, unsigned publication, int size, int keep) {
+    if (size != gridSize) {
+        for (int i = 0; i < 2; i++) {
+            delete[] grids[i];
+            grids[i] = new float[(size_t)size * size];
+            gridLoaded[i] = false;
+        }
+        gridSize = size;
+    }
+    for (int i = 0; i < 2; i++) {
+        if (gridLoaded[i] && gridPublications[i] == publication) {
+            return grids[i];
+        }
+    }
+    int slot = keep == 0 ? 1 : 0;
+    std::memcpy(grids[slot], stream.heights(publication), (size_t)size * size * sizeof(float));
+    gridPublications[slot] = publication;
+    gridLoaded[slot] = true;
+    return grids[slot];
+}
+
+// The time is interpolated as the renderer does. Ripple strength, fade-out
+// and reach are as in ripples.glsl; ripples it would skip for the whole
+// frame are dropped here. The engines take the ripples as impulses instead,
+// so their snapshots draw none.
+void WaveField::setState(const Simulation::Snapshot& snapshot, float blend, HeightStream* stream) {
+    const Simulation::Parameters& parameters = snapshot.parameters;
+    float time = snapshot.previousTime + (snapshot.time - snapshot.previousTime) * blend;
+    state.mode = snapshot.mode;
+    state.time = time;
+    state.scaledTime = time * parameters.waveSpeed;
+    state.waveSpeed = parameters.waveSpeed;
+    state.frequency = parameters.waveFrequency;
+    state.heightScale = parameters.waveHeight;
+    state.rippleCount = 0;
+    state.previous = state.current = nullptr;
+    state.size = 0;
+    state.periodic = snapshot.periodic;
+    state.blend = blend;
+    state.stepRate = 0.0f;
+
+    if (snapshot.size > 0 && stream) {
+        state.size = snapshot.size;
+        state.previous = loadGrid(*stream, snapshot.previousHeights, snapshot.size, -1);
+        state.current = loadGrid(*stream, snapshot.heights, snapshot.size, state.previous == grids[0] ? 0 : 1);
+        if (snapshot.previousHeights != snapshot.heights && snapshot.time > snapshot.previousTime) {
+            state.stepRate = 1.0f / (snapshot.time - snapshot.previousTime);
+        }
+        return;
+    }
+
+    for (int i = 0; i < snapshot.rippleCount && i < RippleManager::CAPACITY; i++) {
+        const RippleManager::Ripple& r = snapshot.ripples[i];
+        float age = time - r.startTime;
+        float strength = 0.5f * r.amplitude * (1.0f - age / RippleManager::LIFETIME);
+        if (age < 0.0f || strength <= RIPPLE_EPSILON) {
+            continue;
+        }
+        float radius = 0.5f * std::log(strength / RIPPLE_EPSILON);
+        ActiveRipple& active = state.ripples[state.rippleCount++];
+        active.x = r.x;
+        active.z = r.z;
+        active.age = age;
+        active.strength = strength;
+        active.strengthRate = -0.5f * r.amplitude / RippleManager::LIFETIME;
+        active.radius2 = radius * radius;
+    }
+}
+
+void WaveField::sample(const float* xs, const float* zs, size_t n, float* h, float* nx, float* nz, float* vy) {
+    size_t tasks = (n + TASK_QUERIES - 1) / TASK_QUERIES;
+    if (tasks > 1 && threads != 1 && !pool) {
+        pool = new WorkerPool(threads);
+    }
+    void (*run)(const State&, const float*, const float*, size_t, size_t, float*, float*, float*, float*) =
+        state.size > 0 ? sampleGrid : kernel->sample;
+    if (tasks <= 1 || !pool || pool->size() == 1) {
+        run(state, xs, zs, 0, n, h, nx, nz, vy);
+        return;
+    }
+    const State& s = state;
+    pool->run((int)tasks, [=, &s](int task) {
+        size_t begin = (size_t)task * TASK_QUERIES;
+        run(s, xs, zs, begin, std::min(begin + TASK_QUERIES, n), h, nx, nz, vy);
+    });
+}
+
+const char* WaveField::getKernelName() const {
+    return kernel->name;
+}
@@ -1,119 +1,233 @@
 #include "WaveRenderer.h"
+#include "WaveFunction.h"
+#include <algorithm>
 #include <cmath>
 #include <cstring>
 #include <iostream>
 #include <sstream>
+#include <utility>
 
 #ifndef M_PI
 #define M_PI 3.14159265358979323846
 #endif
 
+static const int MIN_GRID_SIZE = 32;         // vertices per side of the mesh
+static const int MAX_GRID_SIZE = 1024;
+static const int MAX_AUTO_GRID_SIZE = 256;   // keeps big simulations affordable
+static const float SAMPLES_PER_WAVELENGTH = 8.0f;  // Nyquist needs > 2; a
+                                                   // piecewise-linear sine
+                                                   // needs ~8 to keep its shape
+static const int DEFAULT_FIELD_SIZE = 256;
+static const float LOD_ROOT_SIZE = 256.0f;   // side of the LOD surface
+static const float LOD_HEIGHT_BOUND = 2.0f;  // bounds |height| for culling
+static const int TESS_PATCH_COUNT = 16;     // coarse patches per side
+static const float TESS_PIXELS_PER_SEGMENT = 8.0f;
+static const float TESS_CURVATURE_WEIGHT = 2.0f;
+
+// out = a * b for column-major 4x4 matrices
+static void multiplyMatrices(const float* a, const float* b, float* out) {
+    for (int col = 0; col < 4; col++) {
+        for (int row = 0; row < 4; row++) {
+            float sum = 0.0f;
+            for (int k = 0; k < 4; k++) {
+                sum += a[k * 4 + row] * b[col * 4 + k];
+            }
+            out[col * 4 + row] = sum;
+        }
+    }
+}
+
 WaveRenderer::WaveRenderer() 
-    : VAO(0), VBO(0), EBO(0), shaderManager(nullptr),
-      vertices(nullptr), indices(nullptr), indexCount(0),
-      time(0.0f), waveSpeed(1.0f), waveHeight(0.2f), waveFrequency(5.0f),
-      mouseX(0.0f), mouseY(0.0f), mousePressed(false) {
+    : VAO(0), gridSize(MIN_GRID_SIZE), requestedGridSize(0),
+      lodSurface(nullptr), lod(false), surfaceShaders(nullptr), pendingSurfaceShaders(nullptr),
+      tessShaders(nullptr), pendingTessShaders(nullptr), tessellationSupported(false), tessellation(false),
+      primitivesQuery(0), primitivesPending(false), tessTriangles(0), reloadRequested(false),
+      foam(true), fragmentNormals(false),
+      cameraBlock(CAMERA_BINDING), waveBlock(WAVE_BINDING),
+      heightField(nullptr), fieldSize(DEFAULT_FIELD_SIZE),
+      heightStream(nullptr), mode(Simulation::MODE_ANALYTIC), parameters(Simulation::defaultParameters()),
+      time(0.0f), blend(1.0f), simulatedSize(0), uploadedRippleVersion(0), requested(Simulation::defaultParameters()),
+      requestedMode(Simulation::MODE_ANALYTIC),
+      profiler(nullptr), cpuUpdateSection(-1), profiledStepMilliseconds(0.0),
+      gpuHeightFieldSection(-1), gpuSurfaceSection(-1) {
 }
 
 WaveRenderer::~WaveRenderer() {
-    delete shaderManager;
-    delete[] vertices;
-    delete[] indices;
+    // The simulation thread writes into the stream's mapped memory
+    simulation.stop();
+    delete heightStream;
+    delete surfaceShaders;
+    delete pendingSurfaceShaders;
+    delete tessShaders;
+    delete pendingTessShaders;
+    delete heightField;
+    delete lodSurface;
     
     if (VAO) glDeleteVertexArrays(1, &VAO);
-    if (VBO) glDeleteBuffers(1, &VBO);
-    if (EBO) glDeleteBuffers(1, &EBO);
+    if (primitivesQuery) glDeleteQueries(1, &primitivesQuery);
 }
 
-void WaveRenderer::generateMesh() {
-    // Generate vertices
-    vertices = new float[VERTEX_COUNT * 3];
-    int idx = 0;
-    
-    float step = 2.0f / (GRID_SIZE - 1);
-    for (int z = 0; z < GRID_SIZE; z++) {
-        for (int x = 0; x < GRID_SIZE; x++) {
-            vertices[idx++] = x * step - 1.0f;  // X position [-1, 1]
-            vertices[idx++] = 0.0f;              // Y position (will be modified by shader)
-            vertices[idx++] = z * step - 1.0f;  // Z position [-1, 1]
-        }
+void WaveRenderer::setupBuffers() {
+    glGenVertexArrays(1, &VAO);
+    if (isGridSizeAuto()) {
+        std::cout << "Procedural mesh: resolution follows the surface" << std::endl;
+    } else {
+        std::cout << "Procedural mesh: " << gridSize << "x" << gridSize << " vertices" << std::endl;
     }
-    
-    std::cout << "Generated " << VERTEX_COUNT << " vertices, step size: " << step << std::endl;
-    
-    // Generate indices for triangle strips
-    indexCount = (GRID_SIZE - 1) * (GRID_SIZE - 1) * 6;
-    indices = new unsigned int[indexCount];
-    idx = 0;
-    
-    for (int z = 0; z < GRID_SIZE - 1; z++) {
-        for (int x = 0; x < GRID_SIZE - 1; x++) {
-            unsigned int topLeft = z * GRID_SIZE + x;
-            unsigned int topRight = topLeft + 1;
-            unsigned int bottomLeft = (z + 1) * GRID_SIZE + x;
-            unsigned int bottomRight = bottomLeft + 1;
-            
-            // First triangle
-            indices[idx++] = topLeft;
-            indices[idx++] = bottomLeft;
-            indices[idx++] = topRight;
-            
-            // Second triangle
-            indices[idx++] = topRight;
-            indices[idx++] = bottomLeft;
-            indices[idx++] = bottomRight;
-        }
+}
+
+void WaveRenderer::setGridSize(int size) {
+    requestedGridSize = size > 0 ? std::min(std::max(size, 2), MAX_GRID_SIZE) : 0;
+    gridSize = requestedGridSize > 0 ? requestedGridSize : autoGridSize();
+}
+
+// The analytic waves need SAMPLES_PER_WAVELENGTH vertices per period of
+// their shortest wave across the mesh (2 units wide); the simulated surfaces
+// get a vertex per cell of the height field they upload
+int WaveRenderer::autoGridSize() const {
+    int size;
+    if (simulatedSize > 0) {
+        size = simulatedSize;
+    } else {
+        float wavelengths = 2.0f * WaveFunction::maxWavenumber(parameters.waveFrequency) / (2.0f * (float)M_PI);
+        size = (int)ceil(wavelengths * SAMPLES_PER_WAVELENGTH) + 1;
     }
-    
-    std::cout << "Generated " << indexCount << " indices for triangles" << std::endl;
+    return std::min(std::max(size, MIN_GRID_SIZE), MAX_AUTO_GRID_SIZE);
 }
 
-void WaveRenderer::checkGLError(const std::string& location) {
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        std::cerr << "OpenGL error at " << location << ": " << error << std::endl;
+// A full ring means the simulation has stalled for many steps; the command
+// is dropped rather than blocking input
+void WaveRenderer::submit(Simulation::Command::Type type, float x, float y, int newMode) {
+    Simulation::Command command = { 0.0, type, x, y, newMode };
+    if (!simulation.submit(command)) {
+        std::cerr << "Simulation command queue full; input dropped" << std::endl;
     }
 }
 
-void WaveRenderer::setupBuffers() {
-    glGenVertexArrays(1, &VAO);
-    checkGLError("glGenVertexArrays");
-    glGenBuffers(1, &VBO);
-    checkGLError("glGenBuffers VBO");
-    glGenBuffers(1, &EBO);
-    checkGLError("glGenBuffers EBO");
-    
-    glBindVertexArray(VAO);
-    checkGLError("glBindVertexArray");
-    
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, VERTEX_COUNT * 3 * sizeof(float), vertices, GL_STATIC_DRAW);
-    checkGLError("glBufferData VBO");
-    
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexCount * sizeof(unsigned int), indices, GL_STATIC_DRAW);
-    checkGLError("glBufferData EBO");
-    
-    // Position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
-    checkGLError("glVertexAttribPointer");
-    glEnableVertexAttribArray(0);
-    checkGLError("glEnableVertexAttribArray");
-    
-    glBindVertexArray(0);
-    
+// Pointer in pixels, passed on as [0, 1] across the surface (v upwards)
+void WaveRenderer::setMousePosition(float x, float y, int width, int height) {
+    if (width > 0 && height > 0) {
+        submit(Simulation::Command::POINTER_MOVE, x / width, 1.0f - y / height);
+    }
+}
+
+void WaveRenderer::setMousePressed(bool pressed) {
+    submit(pressed ? Simulation::Command::POINTER_PRESS : Simulation::Command::POINTER_RELEASE);
+}
+
+void WaveRenderer::setWaveSpeed(float speed) {
+    requested.waveSpeed = speed;
+    submit(Simulation::Command::SET_WAVE_SPEED, speed);
+}
+
+void WaveRenderer::setWaveHeight(float height) {
+    requested.waveHeight = height;
+    submit(Simulation::Command::SET_WAVE_HEIGHT, height);
+}
+
+void WaveRenderer::setWaveFrequency(float frequency) {
+    requested.waveFrequency = frequency;
+    submit(Simulation::Command::SET_WAVE_FREQUENCY, frequency);
+}
+
+void WaveRenderer::setSimulationMode(SimulationMode newMode) {
+    requestedMode = newMode;
+    submit(Simulation::Command::SET_MODE, 0.0f, 0.0f, newMode);
+}
+
+void WaveRenderer::setProfiler(FrameProfiler* frameProfiler) {
+    profiler = frameProfiler;
+    if (profiler) {
+        cpuUpdateSection = profiler->addSection("update", false);
+        gpuHeightFieldSection = profiler->addSection("height field", true);
+        gpuSurfaceSection = profiler->addSection("surface", true);
+    }
+}
+
+const char* WaveRenderer::getSimulationModeName() const {
+    switch (requestedMode) {
+        case Simulation::MODE_SOLVER: return "solver";
+        case Simulation::MODE_OCEAN: return "FFT ocean";
+        default: return "analytic";
+    }
+}
+
+// Bit i of a surface variant key enables feature i
+std::vector<std::string> WaveRenderer::surfaceFeatures() {
+    std::vector<std::string> features;
+    features.push_back("FOAM");
+    features.push_back("FRAGMENT_NORMALS");
+    features.push_back("LOD");
+    return features;
+}
+
+unsigned int WaveRenderer::surfaceKey() const {
+    return (foam ? SURFACE_FOAM : 0) | (fragmentNormals ? SURFACE_FRAGMENT_NORMALS : 0)
+         | (isLodActive() ? SURFACE_LOD : 0);
+}
+
+// Needs the LOD shader variants, which the fallback test shaders lack
+bool WaveRenderer::isLodActive() const {
+    return lod && mode == Simulation::MODE_OCEAN && lodSurface && surfaceShaders->size() > SURFACE_LOD;
+}
+
+bool WaveRenderer::isTessellationActive() const {
+    return tessellation && tessShaders && !isLodActive();
+}
+
+int WaveRenderer::getTriangleCount() const {
+    if (isLodActive()) {
+        return lodSurface->getTriangleCount();
+    }
+    if (isTessellationActive()) {
+        return tessTriangles;
+    }
+    return 2 * (gridSize - 1) * (gridSize - 1);
+}
+
+void WaveRenderer::prepareSurfaceShaders() {
+    for (int i = 0; i < surfaceShaders->size(); i++) {
+        ShaderManager* shader = (*surfaceShaders)[i];
+        bindParameterBlocks(*shader);
+        shader->use();
+        shader->setInt("heightField", 0);
+        if (i & SURFACE_LOD) {
+            shader->setInt("patchResolution", LodSurface::PATCH_RESOLUTION);
+        }
+    }
+    for (int i = 0; tessShaders && i < tessShaders->size(); i++) {
+        ShaderManager* shader = (*tessShaders)[i];
+        bindParameterBlocks(*shader);
+        shader->use();
+        shader->setInt("heightField", 0);
+        shader->setInt("patchCount", TESS_PATCH_COUNT);
+        shader->setFloat("pixelsPerSegment", TESS_PIXELS_PER_SEGMENT);
+        shader->setFloat("curvatureWeight", TESS_CURVATURE_WEIGHT);
+    }
+}
+
+// wave.frag behind the tessellation stages; same feature bits as the surface
+ShaderVariants* WaveRenderer::createTessShaders() const {
+    std::vector<std::string> features = surfaceFeatures();
+    features.resize(2);
+    ShaderVariants* shaders = new ShaderVariants("shaders/tess.vert", "shaders/wave.frag", features);
+    shaders->setTessellationShaders("shaders/tess.tesc", "shaders/tess.tese");
+    return shaders;
 }
 
 bool WaveRenderer::initialize() {
-    // Create shader manager
-    shaderManager = new ShaderManager();
+    GLDebug::initialize();
     
     // Try to load wave shaders first
-    if (!shaderManager->loadShaders("shaders/wave.vert", "shaders/wave.frag")) {
+    surfaceShaders = new ShaderVariants("shaders/wave.vert", "shaders/wave.frag", surfaceFeatures());
+    if (!surfaceShaders->compile()) {
         std::cerr << "Failed to load wave shaders, falling back to test shaders..." << std::endl;
         
         // If wave shaders fail, try the test shaders
-        if (!shaderManager->loadShaders("shaders/test.vert", "shaders/test.frag")) {
+        delete surfaceShaders;
+        surfaceShaders = new ShaderVariants("shaders/test.vert", "shaders/test.frag",
+                                            std::vector<std::string>());
+        if (!surfaceShaders->compile()) {
             std::cerr << "Failed to load test shaders as well" << std::endl;
             return false;
         } else {
@@ -123,9 +237,41 @@ bool WaveRenderer::initialize() {
         std::cout << "Wave shaders loaded successfully" << std::endl;
     }
     
-    // Generate mesh and setup OpenGL buffers
-    generateMesh();
+    // Tessellation shaders are core since OpenGL 4.0
+    GLint major = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    tessellationSupported = major >= 4;
+    if (tessellationSupported && surfaceShaders->size() > SURFACE_LOD) {
+        tessShaders = createTessShaders();
+        if (!tessShaders->compile()) {
+            std::cerr << "Failed to load tessellation shaders; the grid stays in use" << std::endl;
+            delete tessShaders;
+            tessShaders = nullptr;
+        }
+    } else if (!tessellationSupported) {
+        std::cout << "Tessellation unavailable: needs OpenGL 4.0" << std::endl;
+    }
+    
+    // Setup OpenGL buffers
     setupBuffers();
+    glGenQueries(1, &primitivesQuery);
+    lodSurface = new LodSurface();
+    lodSurface->initialize(LOD_ROOT_SIZE);
+    heightStream = new HeightStream();
+    int heightSize = simulation.getMaxHeightSize();
+    heightStream->initialize((size_t)heightSize * heightSize);
+    simulation.setHeightStream(heightStream);
+    simulation.initialize();
+    ripples.initialize();
+    cameraBlock.initialize();
+    waveBlock.initialize();
+    prepareSurfaceShaders();
+    
+    heightField = new HeightField(fieldSize);
+    if (!heightField->initialize()) {
+        return false;
+    }
+    shaderWatcher.start("shaders");
     
     // Enable depth testing and blending
     glEnable(GL_DEPTH_TEST);
@@ -137,10 +283,75 @@ bool WaveRenderer::initialize() {
 }
 
 void WaveRenderer::update(float deltaTime) {
-    time += deltaTime;
+    simulation.step(deltaTime);
+}
+
+// Takes the newest snapshot and blends it with the step before: by the
+// wall-clock time since it was published while the simulation thread runs,
+// so motion stays smooth at any refresh rate, and not at all otherwise
+const Simulation::Snapshot& WaveRenderer::applySnapshot() {
+    const Simulation::Snapshot& snapshot = simulation.acquire();
+    blend = 1.0f;
+    if (simulation.isRunning()) {
+        blend = (float)((Simulation::now() - snapshot.publishedAt) / simulation.getStepSeconds());
+        blend = std::min(std::max(blend, 0.0f), 1.0f);
+    }
+    if (profiler) {
+        // Every step since the last frame, whichever snapshots were skipped
+        profiler->addCpuTime(cpuUpdateSection, (float)(snapshot.stepMilliseconds - profiledStepMilliseconds));
+        profiledStepMilliseconds = snapshot.stepMilliseconds;
+    }
+    mode = snapshot.mode;
+    parameters = snapshot.parameters;
+    simulatedSize = snapshot.size;
+    time = snapshot.previousTime + (snapshot.time - snapshot.previousTime) * blend;
+    
+    if (snapshot.rippleVersion != uploadedRippleVersion) {
+        ripples.clear();
+        for (int i = 0; i < snapshot.rippleCount; i++) {
+            const RippleManager::Ripple& r = snapshot.ripples[i];
+            ripples.emit(r.x, r.z, r.startTime, r.amplitude);
+        }
+        uploadedRippleVersion = snapshot.rippleVersion;
+    }
+    waveField.setState(snapshot, blend, heightStream);
+    return snapshot;
 }
 
 void WaveRenderer::render(int screenWidth, int screenHeight) {
+    GL_DEBUG_SCOPE("WaveRenderer::render");
+    pollShaderReload();
+    const Simulation::Snapshot& snapshot = applySnapshot();
+    
+    WaveBlock wave = { time, parameters.waveFrequency, parameters.waveSpeed, parameters.waveHeight };
+    waveBlock.set(wave);
+    waveBlock.upload();
+    
+    // Simulate the surface into the height field before drawing the mesh;
+    // the passes render off-screen with their own viewport
+    if (profiler) profiler->beginGpu(gpuHeightFieldSection);
+    {
+        GL_DEBUG_SCOPE("WaveRenderer::render height field");
+        if (snapshot.size > 0) {
+            heightField->upload(*heightStream, snapshot.previousHeights, snapshot.heights, blend, snapshot.size,
+                                snapshot.periodic ? GL_REPEAT : GL_CLAMP_TO_EDGE);
+        } else {
+            ripples.upload();
+            heightField->renderAnalytic(ripples.size() > 0);
+        }
+        if (isLodActive()) {
+            heightField->generateMipmaps();
+        }
+    }
+    if (profiler) profiler->endGpu(gpuHeightFieldSection);
+    // Fences the frame's copies from the stream. Stepped from this thread,
+    // the simulation gets a free region for its next step even if that
+    // means waiting for the GPU, so runs stay reproducible.
+    heightStream->endFrame(!simulation.isRunning());
+    
+    if (profiler) profiler->beginGpu(gpuSurfaceSection);
+    GL_DEBUG_SCOPE("WaveRenderer::render surface");
+    
     // Set viewport
     glViewport(0, 0, screenWidth, screenHeight);
     
@@ -148,13 +359,21 @@ void WaveRenderer::render(int screenWidth, int screenHeight) {
     glClearColor(0.5f, 0.7f, 0.9f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     
-    // Check for OpenGL errors
-    GLenum error = glGetError();
-    if (error != GL_NO_ERROR) {
-        std::cerr << "OpenGL error before rendering: " << error << std::endl;
+    if (requestedGridSize == 0) {
+        gridSize = autoGridSize();
+    }
+    ShaderManager* surface;
+    if (isTessellationActive()) {
+        surface = tessShaders->get(surfaceKey());
+        surface->use();
+        surface->setVec2("viewportSize", (float)screenWidth, (float)screenHeight);
+    } else {
+        surface = surfaceShaders->get(surfaceKey());
+        surface->use();
+        if (!isLodActive()) {
+            surface->setInt("gridSize", gridSize);
+        }
     }
-    
-    shaderManager->use();
     
     // Setup matrices
     float aspect = (float)screenWidth / (float)screenHeight;
@@ -219,51 +438,143 @@ void WaveRenderer::render(int screenWidth, int screenHeight) {
         -(rX*camX + rY*camY + rZ*camZ), -(uX*camX + uY*camY + uZ*camZ), fX*camX + fY*camY + fZ*camZ, 1
     };
     
-    // Set uniforms
-    shaderManager->setMat4("projection", projection);
-    shaderManager->setMat4("view", view);
-    shaderManager->setFloat("time", time);
-    shaderManager->setVec2("mousePos", (mouseX / screenWidth) * 2.0f - 1.0f, 
-                                       (1.0f - mouseY / screenHeight) * 2.0f - 1.0f);
-    shaderManager->setFloat("mousePressed", mousePressed ? 1.0f : 0.0f);
-    shaderManager->setFloat("waveHeight", waveHeight);
-    shaderManager->setFloat("waveFrequency", waveFrequency);
-    shaderManager->setFloat("waveSpeed", waveSpeed);
-    
-    // Lighting
-    shaderManager->setVec3("lightPos", 2.0f, 5.0f, 2.0f);
-    shaderManager->setVec3("viewPos", camX, camY, camZ);
+    // Camera and lighting
+    CameraBlock camera;
+    std::memcpy(camera.projection, projection, sizeof(projection));
+    std::memcpy(camera.view, view, sizeof(view));
+    camera.viewPos[0] = camX;
+    camera.viewPos[1] = camY;
+    camera.viewPos[2] = camZ;
+    camera.pad0 = 0.0f;
+    camera.lightPos[0] = 2.0f;
+    camera.lightPos[1] = 5.0f;
+    camera.lightPos[2] = 2.0f;
+    camera.pad1 = 0.0f;
+    cameraBlock.set(camera);
+    cameraBlock.upload();
+    
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, heightField->getTexture());
     
     // Debug output (only occasionally to avoid spam)
     static int debugCounter = 0;
     if (debugCounter % 60 == 0) { // Every 60 frames (1 second at 60fps)
         std::cout << "Render debug - Time: " << time 
-                  << ", WaveHeight: " << waveHeight 
+                  << ", WaveHeight: " << parameters.waveHeight 
                   << ", Camera: (" << camX << ", " << camY << ", " << camZ << ")"
-                  << ", IndexCount: " << indexCount << std::endl;
+                  << ", Grid: " << gridSize << "x" << gridSize << std::endl;
     }
     debugCounter++;
     
-    // Render the wave mesh
-    glBindVertexArray(VAO);
-    checkGLError("glBindVertexArray before draw");
-    
-    glDrawElements(GL_TRIANGLES, indexCount, GL_UNSIGNED_INT, 0);
-    checkGLError("glDrawElements");
+    if (isLodActive()) {
+        float viewProjection[16];
+        float cameraPos[3] = { camX, camY, camZ };
+        multiplyMatrices(projection, view, viewProjection);
+        lodSurface->update(viewProjection, cameraPos, LOD_HEIGHT_BOUND);
+        lodSurface->draw();
+    } else if (isTessellationActive()) {
+        drawTessellated();
+    } else {
+        // Render the wave mesh: one strip per pair of grid rows, generated in
+        // wave.vert from the vertex and instance IDs
+        glBindVertexArray(VAO);
+        glDrawArraysInstanced(GL_TRIANGLE_STRIP, 0, 2 * gridSize, gridSize - 1);
+        glBindVertexArray(0);
+    }
+    GL_CHECK("WaveRenderer::render");
     
+    if (profiler) profiler->endGpu(gpuSurfaceSection);
+}
+
+// The triangle count is read back without waiting, so one query is in
+// flight at a time and frames in between go uncounted
+void WaveRenderer::drawTessellated() {
+    if (primitivesPending) {
+        GLuint available = GL_FALSE;
+        glGetQueryObjectuiv(primitivesQuery, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available) {
+            GLuint count = 0;
+            glGetQueryObjectuiv(primitivesQuery, GL_QUERY_RESULT, &count);
+            tessTriangles = (int)count;
+            primitivesPending = false;
+        }
+    }
+    bool counting = !primitivesPending;
+    if (counting) {
+        glBeginQuery(GL_PRIMITIVES_GENERATED, primitivesQuery);
+    }
+    glPatchParameteri(GL_PATCH_VERTICES, 4);
+    glBindVertexArray(VAO);
+    glDrawArrays(GL_PATCHES, 0, 4 * TESS_PATCH_COUNT * TESS_PATCH_COUNT);
     glBindVertexArray(0);
-    checkGLError("glBindVertexArray after draw");
+    if (counting) {
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        primitivesPending = true;
+    }
 }
 
-bool WaveRenderer::loadWaveShaders() {
-    delete shaderManager;
-    shaderManager = new ShaderManager();
-    
-    if (!shaderManager->loadShaders("shaders/wave.vert", "shaders/wave.frag")) {
-        std::cerr << "Failed to load wave shaders" << std::endl;
-        return false;
+void WaveRenderer::loadWaveShaders() {
+    // The pending rebuild read the files before this request; rebuild again
+    // once it is done
+    if (pendingSurfaceShaders) {
+        reloadRequested = true;
+        return;
     }
-    
-    std::cout << "Wave shaders loaded successfully" << std::endl;
-    return true;
-}
\ No newline at end of file
+    std::cout << "Rebuilding shaders in the background..." << std::endl;
+    pendingSurfaceShaders = new ShaderVariants("shaders/wave.vert", "shaders/wave.frag", surfaceFeatures());
+    pendingSurfaceShaders->beginCompile();
+    if (tessellationSupported) {
+        pendingTessShaders = createTessShaders();
+        pendingTessShaders->beginCompile();
+    }
+    heightField->beginReload();
+}
+
+// Called every frame: starts a rebuild when the shader files change and
+// swaps the new programs in once the driver has finished them. The files
+// are read on a background thread and the programs submitted over several
+// frames, so neither step stalls a frame
+void WaveRenderer::pollShaderReload() {
+    if (shaderWatcher.poll()) {
+        loadWaveShaders();
+    }
+    // One set advances at a time, so without parallel compilation each
+    // frame submits at most one program
+    if (!pendingSurfaceShaders || !pendingSurfaceShaders->poll() ||
+        (pendingTessShaders && !pendingTessShaders->poll()) || !heightField->pollReload()) {
+        return;
+    }
+
+    // Every set is linked before any is swapped in: the surface, tessellation
+    // and height field programs share the Wave block and the field layout, so
+    // a partial reload could pair new shaders with stale ones
+    bool ok = pendingSurfaceShaders->finishCompile();
+    if (pendingTessShaders) {
+        ok = pendingTessShaders->finishCompile() && ok;
+    }
+    ok = heightField->finishReload() && ok;
+    if (ok) {
+        std::swap(surfaceShaders, pendingSurfaceShaders);
+        if (pendingTessShaders) {
+            std::swap(tessShaders, pendingTessShaders);
+        }
+        prepareSurfaceShaders();
+        std::cout << "Wave shaders reloaded" << std::endl;
+    } else {
+        std::cerr << "Wave shaders failed to build; keeping the previous ones" << std::endl;
+    }
+    heightField->endReload(ok);
+    // Drop the losing sets' binaries, so edits do not fill the cache
+    pendingSurfaceShaders->evictCache(surfaceShaders);
+    if (pendingTessShaders) {
+        pendingTessShaders->evictCache(tessShaders);
+    }
+    delete pendingSurfaceShaders;
+    delete pendingTessShaders;
+    pendingSurfaceShaders = nullptr;
+    pendingTessShaders = nullptr;
+    if (reloadRequested) {
+        reloadRequested = false;
+        loadWaveShaders();
+    }
+}
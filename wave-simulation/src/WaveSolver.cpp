@@ -0,0 +1,179 @@
+#include "WaveSolver.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define WAVE_X86 1
+#endif
+
+// One row of the leapfrog update:
+//   h(t+1) = (2 h - h(t-1) + C^2 * (N + S + E + W - 4 h)) * damping
+// 'prev' holds h(t-1) on entry and h(t+1) on exit. Cells 0 and n-1 are the
+// fixed boundary and are not touched.
+static void stepRowScalar(const float* up, const float* row, const float* down, float* prev,
+                          int n, float courant2, float damping) {
+    for (int j = 1; j < n - 1; j++) {
+        float laplacian = up[j] + down[j] + row[j - 1] + row[j + 1] - 4.0f * row[j];
+        prev[j] = (2.0f * row[j] - prev[j] + courant2 * laplacian) * damping;
+    }
+}
+
+#ifdef WAVE_X86
+static void stepRowSSE(const float* up, const float* row, const float* down, float* prev,
+                       int n, float courant2, float damping) {
+    __m128 k = _mm_set1_ps(courant2);
+    __m128 d = _mm_set1_ps(damping);
+    __m128 two = _mm_set1_ps(2.0f);
+    __m128 four = _mm_set1_ps(4.0f);
+    int j = 1;
+    for (; j + 4 <= n - 1; j += 4) {
+        __m128 c = _mm_loadu_ps(row + j);
+        __m128 sum = _mm_add_ps(_mm_add_ps(_mm_loadu_ps(up + j), _mm_loadu_ps(down + j)),
+                                _mm_add_ps(_mm_loadu_ps(row + j - 1), _mm_loadu_ps(row + j + 1)));
+        __m128 laplacian = _mm_sub_ps(sum, _mm_mul_ps(four, c));
+        __m128 next = _mm_add_ps(_mm_sub_ps(_mm_mul_ps(two, c), _mm_loadu_ps(prev + j)),
+                                 _mm_mul_ps(k, laplacian));
+        _mm_storeu_ps(prev + j, _mm_mul_ps(next, d));
+    }
+    for (; j < n - 1; j++) {
+        float laplacian = up[j] + down[j] + row[j - 1] + row[j + 1] - 4.0f * row[j];
+        prev[j] = (2.0f * row[j] - prev[j] + courant2 * laplacian) * damping;
+    }
+}
+
+__attribute__((target("avx2,fma")))
+static void stepRowAVX2(const float* up, const float* row, const float* down, float* prev,
+                        int n, float courant2, float damping) {
+    __m256 k = _mm256_set1_ps(courant2);
+    __m256 d = _mm256_set1_ps(damping);
+    __m256 two = _mm256_set1_ps(2.0f);
+    __m256 minusFour = _mm256_set1_ps(-4.0f);
+    int j = 1;
+    for (; j + 8 <= n - 1; j += 8) {
+        __m256 c = _mm256_loadu_ps(row + j);
+        __m256 sum = _mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(up + j), _mm256_loadu_ps(down + j)),
+                                   _mm256_add_ps(_mm256_loadu_ps(row + j - 1), _mm256_loadu_ps(row + j + 1)));
+        __m256 laplacian = _mm256_fmadd_ps(minusFour, c, sum);
+        __m256 next = _mm256_fmadd_ps(k, laplacian, _mm256_fmsub_ps(two, c, _mm256_loadu_ps(prev + j)));
+        _mm256_storeu_ps(prev + j, _mm256_mul_ps(next, d));
+    }
+    for (; j < n - 1; j++) {
+        float laplacian = up[j] + down[j] + row[j - 1] + row[j + 1] - 4.0f * row[j];
+        prev[j] = (2.0f * row[j] - prev[j] + courant2 * laplacian) * damping;
+    }
+}
+#endif
+
+struct WaveSolver::Kernel {
+    const char* name;
+    void (*stepRow)(const float*, const float*, const float*, float*, int, float, float);
+};
+
+static const WaveSolver::Kernel SCALAR_KERNEL = { "scalar", stepRowScalar };
+#ifdef WAVE_X86
+static const WaveSolver::Kernel SSE_KERNEL = { "sse", stepRowSSE };
+static const WaveSolver::Kernel AVX2_KERNEL = { "avx2", stepRowAVX2 };
+#endif
+
+static const WaveSolver::Kernel* selectKernel() {
+#ifdef WAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")) {
+        return &AVX2_KERNEL;
+    }
+    return &SSE_KERNEL;
+#else
+    return &SCALAR_KERNEL;
+#endif
+}
+
+static float* allocateGrid(size_t count) {
+    void* ptr = nullptr;
+    if (posix_memalign(&ptr, 32, count * sizeof(float)) != 0) {
+        return nullptr;
+    }
+    std::memset(ptr, 0, count * sizeof(float));
+    return static_cast<float*>(ptr);
+}
+
+WaveSolver::WaveSolver(int size, WorkerPool* pool)
+    : size(std::max(size, 3)), stride((std::max(size, 3) + 7) & ~7),
+      current(nullptr), previous(nullptr), courant2(0.25f), damping(0.996f),
+      substeps(1), accumulator(0.0f), pool(pool), kernel(selectKernel()) {
+    current = allocateGrid((size_t)this->size * stride);
+    previous = allocateGrid((size_t)this->size * stride);
+}
+
+WaveSolver::~WaveSolver() {
+    free(current);
+    free(previous);
+}
+
+void WaveSolver::reset() {
+    std::memset(current, 0, (size_t)size * stride * sizeof(float));
+    std::memset(previous, 0, (size_t)size * stride * sizeof(float));
+    accumulator = 0.0f;
+}
+
+void WaveSolver::setCourant(float c) {
+    // The explicit 2D scheme is stable for c <= 1/sqrt(2)
+    c = std::max(0.0f, std::min(c, 0.7f));
+    courant2 = c * c;
+}
+
+const char* WaveSolver::getKernelName() const {
+    return kernel->name;
+}
+
+void WaveSolver::addImpulse(float u, float v, float radius, float strength) {
+    // Gaussian bump; only cells within three radii are touched
+    float cx = u * (size - 1);
+    float cy = v * (size - 1);
+    float r = std::max(radius * (size - 1), 1.0f);
+    int reach = (int)std::ceil(r * 3.0f);
+    int i0 = std::max(1, (int)cy - reach);
+    int i1 = std::min(size - 2, (int)cy + reach);
+    int j0 = std::max(1, (int)cx - reach);
+    int j1 = std::min(size - 2, (int)cx + reach);
+    float inv = 1.0f / (r * r);
+
+    for (int i = i0; i <= i1; i++) {
+        float* row = current + (size_t)i * stride;
+        float dy = i - cy;
+        for (int j = j0; j <= j1; j++) {
+            float dx = j - cx;
+            row[j] += strength * std::exp(-(dx * dx + dy * dy) * inv);
+        }
+    }
+}
+
+void WaveSolver::stepRows(int begin, int end) {
+    for (int i = begin; i < end; i++) {
+        const float* row = current + (size_t)i * stride;
+        kernel->stepRow(row - stride, row, row + stride, previous + (size_t)i * stride,
+                        size, courant2, damping);
+    }
+}
+
+void WaveSolver::step() {
+    // Interior rows only; rows 0 and size-1 stay at zero
+    int interior = size - 2;
+    int tiles = (interior + TILE_ROWS - 1) / TILE_ROWS;
+    pool->run(tiles, [this, interior](int tile) {
+        int begin = 1 + tile * TILE_ROWS;
+        stepRows(begin, std::min(1 + interior, begin + TILE_ROWS));
+    });
+    std::swap(current, previous);
+}
+
+void WaveSolver::advance(float deltaTime) {
+    accumulator += deltaTime * TICK_RATE;
+    int ticks = std::min((int)accumulator, MAX_TICKS);
+    accumulator -= (int)accumulator;
+    for (int t = 0; t < ticks * substeps; t++) {
+        step();
+    }
+}
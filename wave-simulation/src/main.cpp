@@ -1,19 +1,594 @@
 #include <allegro5/allegro.h>
 #include <allegro5/allegro_opengl.h>
 #include <allegro5/allegro_font.h>
+#include <allegro5/allegro_primitives.h>
 #include <allegro5/allegro_ttf.h>
 #define GL_GLEXT_PROTOTYPES
 #include <GL/gl.h>
 #include <GL/glext.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
 #include <iostream>
+#include <random>
 #include <sstream>
+#include <vector>
+#include "EventLog.h"
+#include "FrameProfiler.h"
+#include "HeadlessContext.h"
+#include "OceanSpectrum.h"
+#include "Simulation.h"
+#include "WaveField.h"
+#include "WaveFunction.h"
 #include "WaveRenderer.h"
+#include "WaveSolver.h"
 
 const int SCREEN_WIDTH = 1280;
 const int SCREEN_HEIGHT = 720;
 const float FPS = 60.0f;
 
+// Frame-time graphs, drawn to the right of the text HUD
+const float GRAPH_X = 420.0f;
+const float GRAPH_Y = 10.0f;
+const float GRAPH_HEIGHT = 100.0f;
+const float GRAPH_SCALE_MS = 33.3f;   // time at the top of a graph
+const char* const FRAME_TIMES_CSV = "frame_times.csv";
+
+// Times the wave-equation solver alone, without opening a window
+static int runSolverBenchmark(int size, int steps, int threads) {
+    WorkerPool pool(threads);
+    WaveSolver solver(size, &pool);
+    solver.addImpulse(0.5f, 0.5f, 0.05f, 1.0f);
+    solver.step();  // warm up caches and wake the workers
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < steps; i++) {
+        solver.step();
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    
+    double seconds = elapsed.count();
+    double cellUpdates = (double)(size - 2) * (size - 2) * steps;
+    std::cout << "Solver " << size << "x" << size << ", " << pool.size() << " threads, "
+              << solver.getKernelName() << " kernel, " << steps << " steps" << std::endl;
+    std::cout << "  " << seconds * 1000.0 / steps << " ms/step, "
+              << cellUpdates / seconds / 1e9 << " G cell-updates/s, "
+              << steps / seconds << " steps/s" << std::endl;
+    return 0;
+}
+
+// Times one FFT ocean frame (spectrum update plus inverse 2D FFT) at each
+// supported resolution
+static int runOceanBenchmark(int frames, int threads, OceanSpectrum::Spectrum spectrum) {
+    WorkerPool pool(threads);
+    std::cout << "FFT ocean, " << pool.size() << " threads, " << frames << " frames per size" << std::endl;
+    for (int size = 256; size <= 2048; size *= 2) {
+        OceanSpectrum ocean(size, &pool, spectrum);
+        ocean.update(0.0f);  // warm up caches and wake the workers
+        
+        std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++) {
+            ocean.update(i / FPS);
+        }
+        std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+        std::cout << "  " << size << "x" << size << ": " << elapsed.count() / frames << " ms/frame" << std::endl;
+    }
+    return 0;
+}
+
+// Times batches of point queries on the analytic surface with a few live
+// ripples, then checks the heights without ripples against WaveFunction
+static int runFieldBenchmark(int queries, int threads) {
+    const int BATCHES = 20;
+    const int RIPPLES = 8;
+    std::vector<float> xs(queries), zs(queries), h(queries), nx(queries), nz(queries), vy(queries);
+    std::mt19937 random(1);
+    std::uniform_real_distribution<float> coordinate(-1.0f, 1.0f);
+    for (int i = 0; i < queries; i++) {
+        xs[i] = coordinate(random);
+        zs[i] = coordinate(random);
+    }
+    Simulation::Snapshot snapshot;
+    snapshot.previousTime = snapshot.time = 2.5f;
+    snapshot.parameters = Simulation::defaultParameters();
+    snapshot.rippleCount = RIPPLES;
+    for (int i = 0; i < RIPPLES; i++) {
+        RippleManager::Ripple r = { coordinate(random), coordinate(random), 0.25f * i, 1.0f };
+        snapshot.ripples[i] = r;
+    }
+    
+    WaveField field(threads);
+    field.setState(snapshot, 1.0f, nullptr);
+    field.sample(&xs[0], &zs[0], queries, &h[0], &nx[0], &nz[0], &vy[0]);  // starts the pool
+    
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BATCHES; i++) {
+        field.sample(&xs[0], &zs[0], queries, &h[0], &nx[0], &nz[0], &vy[0]);
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    
+    const Simulation::Parameters& parameters = snapshot.parameters;
+    snapshot.rippleCount = 0;
+    field.setState(snapshot, 1.0f, nullptr);
+    field.sample(&xs[0], &zs[0], queries, &h[0], &nx[0], &nz[0]);
+    float maxError = 0.0f;
+    for (int i = 0; i < queries; i++) {
+        float expected = WaveFunction::evaluate(xs[i], zs[i], snapshot.time * parameters.waveSpeed,
+                                                parameters.waveFrequency).height * parameters.waveHeight;
+        maxError = std::max(maxError, std::fabs(h[i] - expected));
+    }
+    
+    double seconds = elapsed.count();
+    std::cout << "Wave field, " << queries << " queries, " << RIPPLES << " ripples, "
+              << field.getThreadCount() << " threads, " << field.getKernelName() << " kernel" << std::endl;
+    std::cout << "  " << seconds * 1000.0 / BATCHES << " ms/batch, "
+              << (double)queries * BATCHES / seconds / 1e6 << " M queries/s, "
+              << "max height error " << maxError << std::endl;
+    return 0;
+}
+
+// Rolling graph of the CPU or the GPU sections of the profiler, one column
+// per frame with the newest on the right and the sections stacked, plus a
+// legend with each section's mean over the history
+static void drawTimingGraph(ALLEGRO_FONT* font, const FrameProfiler& profiler, bool gpu, float x, float y) {
+    const ALLEGRO_COLOR palette[] = {
+        al_map_rgb(80, 200, 120), al_map_rgb(240, 180, 60), al_map_rgb(90, 150, 250), al_map_rgb(230, 90, 200)
+    };
+    
+    float width = (float)FrameProfiler::HISTORY;
+    al_draw_filled_rectangle(x, y, x + width, y + GRAPH_HEIGHT, al_map_rgba(0, 0, 0, 160));
+    // 60 Hz budget
+    float budgetY = y + GRAPH_HEIGHT * (1.0f - 1000.0f / FPS / GRAPH_SCALE_MS);
+    al_draw_line(x, budgetY, x + width, budgetY, al_map_rgba(255, 255, 255, 120), 1.0f);
+    
+    int frames = profiler.getFrameCount();
+    for (int age = 1; age <= frames; age++) {
+        float column = x + width - age + 0.5f;
+        float bottom = y + GRAPH_HEIGHT;
+        int color = 0;
+        for (int i = 0; i < profiler.getSectionCount(); i++) {
+            if (profiler.isGpuSection(i) != gpu) {
+                continue;
+            }
+            float time = profiler.getTime(i, age);
+            if (time > 0.0f) {
+                float top = std::max(bottom - time / GRAPH_SCALE_MS * GRAPH_HEIGHT, y);
+                al_draw_line(column, bottom, column, top, palette[color % 4], 1.0f);
+                bottom = top;
+            }
+            color++;
+        }
+    }
+    
+    std::stringstream ss;
+    ss.precision(2);
+    ss << std::fixed << (gpu ? "GPU" : "CPU");
+    int color = 0;
+    float legendY = y + GRAPH_HEIGHT + 4.0f;
+    al_draw_text(font, al_map_rgb(255, 255, 255), x, legendY, 0, ss.str().c_str());
+    for (int i = 0; i < profiler.getSectionCount(); i++) {
+        if (profiler.isGpuSection(i) != gpu) {
+            continue;
+        }
+        float sum = 0.0f;
+        int count = 0;
+        for (int age = 1; age <= frames; age++) {
+            float time = profiler.getTime(i, age);
+            if (time != FrameProfiler::MISSING) {
+                sum += time;
+                count++;
+            }
+        }
+        ss.str("");
+        ss << profiler.getSectionName(i) << " " << (count ? sum / count : 0.0f) << " ms";
+        legendY += 12.0f;
+        al_draw_text(font, palette[color % 4], x, legendY, 0, ss.str().c_str());
+        color++;
+    }
+}
+
+// Ids of the PARAMETER records a recording starts with
+enum RecordedParameter { PARAMETER_MODE, PARAMETER_WAVE_SPEED, PARAMETER_WAVE_HEIGHT, PARAMETER_WAVE_FREQUENCY };
+
+// Keyboard and mouse handling, shared by the interactive run and the
+// replays. Mouse positions are pixels of a width x height window. Returns
+// false when the key asks to exit; C does nothing without a profiler.
+static bool handleInput(const ALLEGRO_EVENT& event, int width, int height, WaveRenderer& waveRenderer,
+                        FrameProfiler* profiler) {
+    switch (event.type) {
+        case ALLEGRO_EVENT_KEY_DOWN:
+            switch (event.keyboard.keycode) {
+                case ALLEGRO_KEY_ESCAPE:
+                    return false;
+                case ALLEGRO_KEY_Q:
+                    waveRenderer.setWaveSpeed(std::min(waveRenderer.getWaveSpeed() + 0.1f, 5.0f));
+                    break;
+                case ALLEGRO_KEY_A:
+                    waveRenderer.setWaveSpeed(std::max(waveRenderer.getWaveSpeed() - 0.1f, 0.1f));
+                    break;
+                case ALLEGRO_KEY_W:
+                    waveRenderer.setWaveHeight(std::min(waveRenderer.getWaveHeight() + 0.05f, 1.0f));
+                    break;
+                case ALLEGRO_KEY_S:
+                    waveRenderer.setWaveHeight(std::max(waveRenderer.getWaveHeight() - 0.05f, 0.05f));
+                    break;
+                case ALLEGRO_KEY_E:
+                    waveRenderer.setWaveFrequency(std::min(waveRenderer.getWaveFrequency() + 0.5f, 20.0f));
+                    break;
+                case ALLEGRO_KEY_D:
+                    waveRenderer.setWaveFrequency(std::max(waveRenderer.getWaveFrequency() - 0.5f, 1.0f));
+                    break;
+                case ALLEGRO_KEY_M:
+                    // Cycle analytic -> solver -> ocean
+                    waveRenderer.setSimulationMode((WaveRenderer::SimulationMode)
+                        ((waveRenderer.getSimulationMode() + 1) % (Simulation::MODE_OCEAN + 1)));
+                    break;
+                case ALLEGRO_KEY_F:
+                    waveRenderer.setFoam(!waveRenderer.getFoam());
+                    break;
+                case ALLEGRO_KEY_N:
+                    waveRenderer.setFragmentNormals(!waveRenderer.getFragmentNormals());
+                    break;
+                case ALLEGRO_KEY_SPACE:
+                    waveRenderer.loadWaveShaders();
+                    break;
+                case ALLEGRO_KEY_R: {
+                    // Cycle automatic -> 32 -> 64 -> ... -> 512 -> automatic
+                    int size = waveRenderer.isGridSizeAuto() ? 32 : waveRenderer.getGridSize() * 2;
+                    waveRenderer.setGridSize(size > 512 ? 0 : size);
+                    break;
+                }
+                case ALLEGRO_KEY_L:
+                    waveRenderer.setLod(!waveRenderer.getLod());
+                    break;
+                case ALLEGRO_KEY_T:
+                    waveRenderer.setTessellation(!waveRenderer.getTessellation());
+                    break;
+                case ALLEGRO_KEY_C:
+                    if (profiler) {
+                        profiler->writeCsv(FRAME_TIMES_CSV);
+                    }
+                    break;
+            }
+            break;
+            
+        case ALLEGRO_EVENT_MOUSE_AXES:
+            waveRenderer.setMousePosition(event.mouse.x, event.mouse.y, width, height);
+            break;
+            
+        case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
+            if (event.mouse.button == 1) {
+                waveRenderer.setMousePressed(true);
+            }
+            break;
+            
+        case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
+            if (event.mouse.button == 1) {
+                waveRenderer.setMousePressed(false);
+            }
+            break;
+    }
+    return true;
+}
+
+static void recordParameters(EventLog::Writer& recorder, const WaveRenderer& waveRenderer) {
+    recorder.write(EventLog::parameter(0, PARAMETER_MODE, (float)waveRenderer.getSimulationMode()));
+    recorder.write(EventLog::parameter(0, PARAMETER_WAVE_SPEED, waveRenderer.getWaveSpeed()));
+    recorder.write(EventLog::parameter(0, PARAMETER_WAVE_HEIGHT, waveRenderer.getWaveHeight()));
+    recorder.write(EventLog::parameter(0, PARAMETER_WAVE_FREQUENCY, waveRenderer.getWaveFrequency()));
+}
+
+// Feeds the records stamped with step, from index next on, to the renderer
+// as if they had just arrived; returns the index of the first later record.
+// Mouse positions stay in the recorded window's pixels, whatever the size
+// (or, before the first frame, the absence) of the current one.
+static size_t replayStep(const EventLog::Log& log, size_t next, unsigned step, WaveRenderer& waveRenderer) {
+    for (; next < log.records.size() && log.records[next].step <= step; next++) {
+        const EventLog::Record& record = log.records[next];
+        if (record.type != EventLog::PARAMETER) {
+            handleInput(EventLog::toEvent(record, log.header, log.header.width, log.header.height),
+                        log.header.width, log.header.height, waveRenderer, nullptr);
+            continue;
+        }
+        switch (record.key) {
+            case PARAMETER_MODE: waveRenderer.setSimulationMode((WaveRenderer::SimulationMode)(int)record.value); break;
+            case PARAMETER_WAVE_SPEED: waveRenderer.setWaveSpeed(record.value); break;
+            case PARAMETER_WAVE_HEIGHT: waveRenderer.setWaveHeight(record.value); break;
+            case PARAMETER_WAVE_FREQUENCY: waveRenderer.setWaveFrequency(record.value); break;
+        }
+    }
+    return next;
+}
+
+// Command-line settings applied to the WaveRenderer in both the windowed and
+// the headless run
+struct RendererOptions {
+    int gridSize;   // 0 = automatic
+    bool lod;
+    bool tessellation;
+    int fieldSize;
+    int solverSize;
+    int oceanSize;
+    OceanSpectrum::Spectrum spectrum;
+    WaveRenderer::SimulationMode mode;
+};
+
+static bool initializeRenderer(WaveRenderer& waveRenderer, const RendererOptions& options) {
+    waveRenderer.setGridSize(options.gridSize);
+    waveRenderer.setLod(options.lod);
+    waveRenderer.setTessellation(options.tessellation);
+    if (options.fieldSize > 0) {
+        waveRenderer.setFieldSize(options.fieldSize);
+    }
+    if (options.solverSize > 0) {
+        waveRenderer.setSolverSize(options.solverSize);
+    }
+    if (options.oceanSize > 0) {
+        waveRenderer.setOceanSize(options.oceanSize);
+    }
+    waveRenderer.setOceanSpectrum(options.spectrum);
+    if (!waveRenderer.initialize()) {
+        return false;
+    }
+    waveRenderer.setSimulationMode(options.mode);
+    return true;
+}
+
+// A JSON string literal, quotes included
+static std::string jsonString(const std::string& text) {
+    std::ostringstream out;
+    out << '"';
+    for (size_t i = 0; i < text.size(); i++) {
+        unsigned char c = (unsigned char)text[i];
+        if (c == '"' || c == '\\') {
+            out << '\\' << (char)c;
+        } else if (c < 0x20) {
+            char escape[8];
+            snprintf(escape, sizeof(escape), "\\u%04x", c);
+            out << escape;
+        } else {
+            out << (char)c;
+        }
+    }
+    out << '"';
+    return out.str();
+}
+
+// Minimum, mean and 99th percentile of a series of frame times, as a JSON object
+static std::string timingJson(std::vector<double> samples) {
+    if (samples.empty()) {
+        return "null";
+    }
+    std::sort(samples.begin(), samples.end());
+    double sum = 0.0;
+    for (size_t i = 0; i < samples.size(); i++) {
+        sum += samples[i];
+    }
+    std::ostringstream out;
+    out << "{ \"min\": " << samples.front() << ", \"avg\": " << sum / samples.size()
+        << ", \"p99\": " << EventLog::percentile(samples, 99.0) << " }";
+    return out.str();
+}
+
+// Renders a fixed number of frames into an offscreen framebuffer at a fixed
+// 1/FPS time step, so runs are reproducible, and reports CPU and GPU frame
+// times as JSON (to jsonPath, or report when it is empty). CPU time covers
+// update() and render(); GPU time comes from a GL_TIME_ELAPSED query per
+// frame, read back only after the last frame so the loop never waits on the
+// GPU. Frames listed in dumpFrames are saved as <dumpPrefix>_NNNN.ppm.
+// With a replay, its time step replaces 1/FPS, each step takes the records
+// stamped for it, and the run (warm-up included) lasts as many steps as the
+// recording did, so frames is ignored.
+static int runHeadless(int width, int height, int frames, const RendererOptions& options,
+                       const std::vector<int>& dumpFrames, const std::string& dumpPrefix,
+                       const std::string& jsonPath, const EventLog::Log* replay, std::ostream& report) {
+    static const int WARMUP_FRAMES = 3;
+    float timestep = replay ? replay->header.timestep : 1.0f / FPS;
+    if (replay) {
+        frames = std::max((int)replay->steps - WARMUP_FRAMES, 1);
+    }
+    
+    HeadlessContext context(width, height);
+    if (!context.initialize()) {
+        return -1;
+    }
+    const std::string rendererName = (const char*)glGetString(GL_RENDERER);
+    
+    int status = 0;
+    {
+        // Scoped so the renderer releases its GL objects before the context goes
+        WaveRenderer waveRenderer;
+        if (!initializeRenderer(waveRenderer, options)) {
+            std::cerr << "Failed to initialize wave renderer" << std::endl;
+            return -1;
+        }
+        
+        unsigned step = 0;
+        size_t nextRecord = 0;
+        for (int i = 0; i < WARMUP_FRAMES; i++, step++) {
+            if (replay) {
+                nextRecord = replayStep(*replay, nextRecord, step, waveRenderer);
+            }
+            waveRenderer.update(timestep);
+            waveRenderer.render(width, height);
+        }
+        glFinish();
+        
+        std::vector<GLuint> queries(frames);
+        glGenQueries(frames, &queries[0]);
+        std::vector<double> cpuTimes;
+        cpuTimes.reserve(frames);
+        
+        std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; i++, step++) {
+            if (replay) {
+                nextRecord = replayStep(*replay, nextRecord, step, waveRenderer);
+            }
+            std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            glBeginQuery(GL_TIME_ELAPSED, queries[i]);
+            waveRenderer.update(timestep);
+            waveRenderer.render(width, height);
+            glEndQuery(GL_TIME_ELAPSED);
+            std::chrono::duration<double, std::milli> cpu = std::chrono::steady_clock::now() - start;
+            cpuTimes.push_back(cpu.count());
+            
+            if (std::find(dumpFrames.begin(), dumpFrames.end(), i) != dumpFrames.end()) {
+                char path[32];
+                snprintf(path, sizeof(path), "_%04d.ppm", i);
+                if (!context.writePPM(dumpPrefix + path)) {
+                    status = -1;
+                }
+            }
+        }
+        glFinish();
+        std::chrono::duration<double> wall = std::chrono::steady_clock::now() - runStart;
+        
+        std::vector<double> gpuTimes;
+        gpuTimes.reserve(frames);
+        for (int i = 0; i < frames; i++) {
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(queries[i], GL_QUERY_RESULT, &elapsed);
+            gpuTimes.push_back(elapsed / 1e6);
+        }
+        glDeleteQueries(frames, &queries[0]);
+        
+        std::ostringstream json;
+        json << "{\n"
+             << "  \"renderer\": " << jsonString(rendererName) << ",\n"
+             << "  \"width\": " << width << ",\n"
+             << "  \"height\": " << height << ",\n"
+             << "  \"frames\": " << frames << ",\n"
+             << "  \"mode\": " << jsonString(waveRenderer.getSimulationModeName()) << ",\n"
+             << "  \"grid\": " << waveRenderer.getGridSize() << ",\n"
+             << "  \"tessellation\": " << (waveRenderer.getTessellation() && waveRenderer.isTessellationSupported()
+                                           ? "true" : "false") << ",\n"
+             << "  \"triangles\": " << waveRenderer.getTriangleCount() << ",\n"
+             << "  \"fps\": " << frames / wall.count() << ",\n"
+             << "  \"cpu_ms\": " << timingJson(cpuTimes) << ",\n"
+             << "  \"gpu_ms\": " << timingJson(gpuTimes) << "\n"
+             << "}\n";
+        if (jsonPath.empty()) {
+            report << json.str() << std::flush;
+        } else {
+            std::ofstream file(jsonPath.c_str());
+            file << json.str();
+            if (!file) {
+                std::cerr << "Cannot write " << jsonPath << std::endl;
+                status = -1;
+            }
+        }
+    }
+    return status;
+}
+
 int main(int argc, char** argv) {
+    RendererOptions options = { 0, false, false, 0, 0, 0, OceanSpectrum::PHILLIPS, Simulation::MODE_ANALYTIC };
+    int threads = 0;
+    int benchSteps = 0;
+    int benchOceanFrames = 0;
+    int benchFieldQueries = 0;
+    bool headless = false;
+    int headlessFrames = 300;
+    int headlessWidth = SCREEN_WIDTH;
+    int headlessHeight = SCREEN_HEIGHT;
+    std::vector<int> dumpFrames;
+    std::string dumpPrefix = "frame";
+    std::string jsonPath;
+    std::string recordPath;
+    std::string replayPath;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--no-shader-cache") == 0) {
+            ShaderManager::setCacheDirectory("");
+        } else if (strcmp(argv[i], "--grid-size") == 0 && i + 1 < argc) {
+            options.gridSize = atoi(argv[++i]);   // "auto" parses as 0
+        } else if (strcmp(argv[i], "--lod") == 0) {
+            options.lod = true;
+        } else if (strcmp(argv[i], "--tessellation") == 0) {
+            options.tessellation = true;
+        } else if (strcmp(argv[i], "--field-size") == 0 && i + 1 < argc) {
+            options.fieldSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--solver-size") == 0 && i + 1 < argc) {
+            options.solverSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--ocean-size") == 0 && i + 1 < argc) {
+            options.oceanSize = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--spectrum") == 0 && i + 1 < argc) {
+            options.spectrum = strcmp(argv[++i], "jonswap") == 0 ? OceanSpectrum::JONSWAP : OceanSpectrum::PHILLIPS;
+        } else if (strcmp(argv[i], "--mode") == 0 && i + 1 < argc) {
+            i++;
+            options.mode = strcmp(argv[i], "solver") == 0 ? Simulation::MODE_SOLVER
+                         : strcmp(argv[i], "ocean") == 0 ? Simulation::MODE_OCEAN
+                         : Simulation::MODE_ANALYTIC;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--bench-solver") == 0) {
+            benchSteps = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 200;
+        } else if (strcmp(argv[i], "--bench-ocean") == 0) {
+            benchOceanFrames = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 50;
+        } else if (strcmp(argv[i], "--bench-field") == 0) {
+            benchFieldQueries = (i + 1 < argc && argv[i + 1][0] != '-') ? atoi(argv[++i]) : 1000000;
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            headlessFrames = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &headlessWidth, &headlessHeight) != 2) {
+                headlessWidth = headlessHeight = 0;
+            }
+        } else if (strcmp(argv[i], "--dump-frames") == 0 && i + 1 < argc) {
+            // Comma-separated frame numbers, counted from 0
+            std::stringstream list(argv[++i]);
+            std::string frame;
+            while (std::getline(list, frame, ',')) {
+                dumpFrames.push_back(atoi(frame.c_str()));
+            }
+        } else if (strcmp(argv[i], "--dump-prefix") == 0 && i + 1 < argc) {
+            dumpPrefix = argv[++i];
+        } else if (strcmp(argv[i], "--json") == 0 && i + 1 < argc) {
+            jsonPath = argv[++i];
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            recordPath = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replayPath = argv[++i];
+        }
+    }
+    
+    if (options.oceanSize > 0 && !FFT::isPowerOfTwo(options.oceanSize)) {
+        std::cerr << "--ocean-size must be a power of two" << std::endl;
+        return -1;
+    }
+    if (benchSteps > 0) {
+        return runSolverBenchmark(options.solverSize > 0 ? options.solverSize : 2048, benchSteps, threads);
+    }
+    if (benchOceanFrames > 0) {
+        return runOceanBenchmark(benchOceanFrames, threads, options.spectrum);
+    }
+    if (benchFieldQueries > 0) {
+        return runFieldBenchmark(benchFieldQueries, threads);
+    }
+    EventLog::Log replay;
+    bool replaying = !replayPath.empty();
+    if (replaying && !replay.load(replayPath)) {
+        std::cerr << "Cannot read event log " << replayPath << std::endl;
+        return -1;
+    }
+    if (headless) {
+        if (headlessWidth <= 0 || headlessHeight <= 0 || headlessFrames <= 0) {
+            std::cerr << "--headless needs a positive --frames and a --size like 1280x720" << std::endl;
+            return -1;
+        }
+        // Diagnostics go to stderr, so stdout carries the report alone
+        std::streambuf* stdoutBuffer = std::cout.rdbuf(std::cerr.rdbuf());
+        std::ostream report(stdoutBuffer);
+        int status = runHeadless(headlessWidth, headlessHeight, headlessFrames, options,
+                                 dumpFrames, dumpPrefix, jsonPath, replaying ? &replay : nullptr, report);
+        std::cout.rdbuf(stdoutBuffer);
+        return status;
+    }
+    
     // Initialize Allegro
     if (!al_init()) {
         std::cerr << "Failed to initialize Allegro" << std::endl;
@@ -25,6 +600,7 @@ int main(int argc, char** argv) {
     al_install_mouse();
     al_init_font_addon();
     al_init_ttf_addon();
+    al_init_primitives_addon();
     
     // Set OpenGL attributes
     al_set_new_display_flags(ALLEGRO_OPENGL | ALLEGRO_OPENGL_3_0 | ALLEGRO_PROGRAMMABLE_PIPELINE);
@@ -47,9 +623,14 @@ int main(int argc, char** argv) {
         return -1;
     }
     
-    // Create event queue and timer
+    // Create event queue and timer. The timer only paces redraws, at the
+    // display's refresh rate when it is known; the simulation steps at FPS
+    // on its own thread. A replay steps the simulation on each tick instead,
+    // at the recorded rate.
     ALLEGRO_EVENT_QUEUE* event_queue = al_create_event_queue();
-    ALLEGRO_TIMER* timer = al_create_timer(1.0 / FPS);
+    int refreshRate = al_get_display_refresh_rate(display);
+    ALLEGRO_TIMER* timer = al_create_timer(replaying ? replay.header.timestep
+                                           : 1.0 / (refreshRate > 0 ? refreshRate : FPS));
     
     // Register event sources
     al_register_event_source(event_queue, al_get_display_event_source(display));
@@ -57,9 +638,10 @@ int main(int argc, char** argv) {
     al_register_event_source(event_queue, al_get_keyboard_event_source());
     al_register_event_source(event_queue, al_get_mouse_event_source());
     
-    // Initialize wave renderer
+    // Initialize wave renderer; the profiler outlives it
+    FrameProfiler profiler;
     WaveRenderer waveRenderer;
-    if (!waveRenderer.initialize()) {
+    if (!initializeRenderer(waveRenderer, options)) {
         std::cerr << "Failed to initialize wave renderer" << std::endl;
         al_destroy_font(font);
         al_destroy_timer(timer);
@@ -67,19 +649,34 @@ int main(int argc, char** argv) {
         al_destroy_display(display);
         return -1;
     }
+    waveRenderer.setProfiler(&profiler);
+    int cpuRenderSection = profiler.addSection("render", false);
+    int cpuFlipSection = profiler.addSection("flip", false);
     
     // Game state
     bool running = true;
     bool redraw = true;
-    float mouseX = 0, mouseY = 0;
-    bool mousePressed = false;
     
-    // Wave parameters
-    float waveSpeed = 1.0f;
-    float waveHeight = 0.2f;
-    float waveFrequency = 5.0f;
+    // Input is recorded against the steps that take it, from the starting
+    // parameters on
+    EventLog::Writer recorder;
+    EventLog::Record record;
+    if (!recordPath.empty()) {
+        if (recorder.open(recordPath, 1.0f / FPS, al_get_display_width(display), al_get_display_height(display))) {
+            recordParameters(recorder, waveRenderer);
+        } else {
+            std::cerr << "Cannot write event log " << recordPath << std::endl;
+        }
+    }
+    unsigned replayedSteps = 0;
+    size_t nextRecord = 0;
+    std::vector<double> frameTimes;
+    std::chrono::steady_clock::time_point lastFlip;
     
-    // Start timer
+    // Start the simulation and the redraw timer
+    if (!replaying) {
+        waveRenderer.startSimulation(1.0f / FPS);
+    }
     al_start_timer(timer);
     
     while (running) {
@@ -88,7 +685,15 @@ int main(int argc, char** argv) {
         
         switch (event.type) {
             case ALLEGRO_EVENT_TIMER:
-                waveRenderer.update(1.0f / FPS);
+                if (replaying) {
+                    if (replayedSteps == replay.steps) {
+                        running = false;
+                        break;
+                    }
+                    nextRecord = replayStep(replay, nextRecord, replayedSteps, waveRenderer);
+                    waveRenderer.update(replay.header.timestep);
+                    replayedSteps++;
+                }
                 redraw = true;
                 break;
                 
@@ -97,59 +702,23 @@ int main(int argc, char** argv) {
                 break;
                 
             case ALLEGRO_EVENT_KEY_DOWN:
-                switch (event.keyboard.keycode) {
-                    case ALLEGRO_KEY_ESCAPE:
-                        running = false;
-                        break;
-                    case ALLEGRO_KEY_Q:
-                        waveSpeed = std::min(waveSpeed + 0.1f, 5.0f);
-                        waveRenderer.setWaveSpeed(waveSpeed);
-                        break;
-                    case ALLEGRO_KEY_A:
-                        waveSpeed = std::max(waveSpeed - 0.1f, 0.1f);
-                        waveRenderer.setWaveSpeed(waveSpeed);
-                        break;
-                    case ALLEGRO_KEY_W:
-                        waveHeight = std::min(waveHeight + 0.05f, 1.0f);
-                        waveRenderer.setWaveHeight(waveHeight);
-                        break;
-                    case ALLEGRO_KEY_S:
-                        waveHeight = std::max(waveHeight - 0.05f, 0.05f);
-                        waveRenderer.setWaveHeight(waveHeight);
-                        break;
-                    case ALLEGRO_KEY_E:
-                        waveFrequency = std::min(waveFrequency + 0.5f, 20.0f);
-                        waveRenderer.setWaveFrequency(waveFrequency);
-                        break;
-                    case ALLEGRO_KEY_D:
-                        waveFrequency = std::max(waveFrequency - 0.5f, 1.0f);
-                        waveRenderer.setWaveFrequency(waveFrequency);
-                        break;
-                    case ALLEGRO_KEY_SPACE:
-                        std::cout << "Switching to wave shaders..." << std::endl;
-                        waveRenderer.loadWaveShaders();
-                        break;
-                }
-                break;
-                
             case ALLEGRO_EVENT_MOUSE_AXES:
-                mouseX = event.mouse.x;
-                mouseY = event.mouse.y;
-                waveRenderer.setMousePosition(mouseX, mouseY);
-                break;
-                
             case ALLEGRO_EVENT_MOUSE_BUTTON_DOWN:
-                if (event.mouse.button == 1) {
-                    mousePressed = true;
-                    waveRenderer.setMousePressed(true);
-                }
-                break;
-                
             case ALLEGRO_EVENT_MOUSE_BUTTON_UP:
-                if (event.mouse.button == 1) {
-                    mousePressed = false;
-                    waveRenderer.setMousePressed(false);
+                if (replaying) {
+                    // Live input would change what the replay measures; only ESC counts
+                    running = !(event.type == ALLEGRO_EVENT_KEY_DOWN && event.keyboard.keycode == ALLEGRO_KEY_ESCAPE);
+                    break;
+                }
+                // Held, every command of the event is applied by the step
+                // after the stamp, which is where the replay feeds it
+                waveRenderer.holdCommands();
+                if (recorder.isOpen() && EventLog::toRecord(event, waveRenderer.getStepCount(), record)) {
+                    recorder.write(record);
                 }
+                running = handleInput(event, al_get_display_width(display), al_get_display_height(display),
+                                      waveRenderer, &profiler);
+                waveRenderer.releaseCommands();
                 break;
         }
         
@@ -157,7 +726,9 @@ int main(int argc, char** argv) {
             redraw = false;
             
             // Render wave
+            profiler.beginCpu(cpuRenderSection);
             waveRenderer.render(SCREEN_WIDTH, SCREEN_HEIGHT);
+            profiler.endCpu(cpuRenderSection);
             
             // Draw UI overlay
             al_set_target_backbuffer(display);
@@ -174,19 +745,64 @@ int main(int argc, char** argv) {
             al_draw_text(font, al_map_rgb(255, 255, 255), 10, 110, 0, 
                         "Mouse Click - Create Ripples");
             al_draw_text(font, al_map_rgb(255, 255, 255), 10, 130, 0, 
-                        "SPACE - Switch to Wave Shaders");
+                        "SPACE - Reload Shaders");
             al_draw_text(font, al_map_rgb(255, 255, 255), 10, 150, 0, 
+                        "M - Cycle Analytic / Solver / FFT Ocean");
+            al_draw_text(font, al_map_rgb(255, 255, 255), 10, 170, 0, 
+                        "F/N - Toggle Foam / Per-Pixel Normals");
+            al_draw_text(font, al_map_rgb(255, 255, 255), 10, 190, 0, 
+                        "R/L - Cycle Mesh Resolution / Toggle Ocean LOD");
+            al_draw_text(font, al_map_rgb(255, 255, 255), 10, 210, 0, 
+                        "T - Toggle GPU Tessellation");
+            al_draw_text(font, al_map_rgb(255, 255, 255), 10, 230, 0, 
+                        "C - Export Frame Times (CSV)");
+            al_draw_text(font, al_map_rgb(255, 255, 255), 10, 250, 0, 
                         "ESC - Exit");
             
             // Display current values
             std::stringstream ss;
-            ss << "Speed: " << waveSpeed << " Height: " << waveHeight << " Frequency: " << waveFrequency;
-            al_draw_text(font, al_map_rgb(255, 255, 0), 10, 180, 0, ss.str().c_str());
+            ss << "Speed: " << waveRenderer.getWaveSpeed() << " Height: " << waveRenderer.getWaveHeight()
+               << " Frequency: " << waveRenderer.getWaveFrequency();
+            al_draw_text(font, al_map_rgb(255, 255, 0), 10, 280, 0, ss.str().c_str());
+            ss.str("");
+            ss << "Mode: " << waveRenderer.getSimulationModeName()
+               << "  Foam: " << (waveRenderer.getFoam() ? "on" : "off")
+               << "  Normals: " << (waveRenderer.getFragmentNormals() ? "per pixel" : "per vertex");
+            al_draw_text(font, al_map_rgb(255, 255, 0), 10, 300, 0, ss.str().c_str());
+            ss.str("");
+            ss << "Mesh: " << waveRenderer.getGridSize() << "x" << waveRenderer.getGridSize()
+               << (waveRenderer.isGridSizeAuto() ? " (auto)" : "")
+               << "  LOD: " << (waveRenderer.getLod() ? "on" : "off")
+               << "  Tessellation: " << (!waveRenderer.isTessellationSupported() ? "unavailable"
+                                         : waveRenderer.getTessellation() ? "on" : "off")
+               << "  Triangles: " << waveRenderer.getTriangleCount();
+            al_draw_text(font, al_map_rgb(255, 255, 0), 10, 320, 0, ss.str().c_str());
             
+            // Frame-time graphs; the GPU times lag FrameProfiler::LATENCY frames
+            drawTimingGraph(font, profiler, false, GRAPH_X, GRAPH_Y);
+            drawTimingGraph(font, profiler, true, GRAPH_X + FrameProfiler::HISTORY + 20.0f, GRAPH_Y);
+            
+            profiler.beginCpu(cpuFlipSection);
             al_flip_display();
+            profiler.endCpu(cpuFlipSection);
+            profiler.endFrame();
+            
+            std::chrono::steady_clock::time_point flip = std::chrono::steady_clock::now();
+            if (lastFlip != std::chrono::steady_clock::time_point()) {
+                frameTimes.push_back(std::chrono::duration<double, std::milli>(flip - lastFlip).count());
+            }
+            lastFlip = flip;
         }
     }
     
+    if (recorder.isOpen() && !recorder.close(waveRenderer.getStepCount())) {
+        std::cerr << "Cannot write event log " << recordPath << std::endl;
+    }
+    if (replaying) {
+        std::cout << "Replayed " << replayedSteps << " of " << replay.steps << " steps, frame ms: "
+                  << timingJson(frameTimes) << std::endl;
+    }
+    
     // Cleanup
     al_destroy_font(font);
     al_destroy_timer(timer);